@@ -35,10 +35,8 @@ ColorTextureProgram::ColorTextureProgram() {
 	//As you can see above, adjacent strings in C/C++ are concatenated.
 	// this is very useful for writing long shader programs inline.
 
-	// //look up the locations of vertex attributes:
-	Color_vec3 = glGetAttribLocation(program, "textColor");
-
 	// //look up the locations of uniforms:
+	Color_vec3 = glGetUniformLocation(program, "textColor");
 	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "projection");
 
 	//set TEX to always refer to texture binding zero:
@@ -10,8 +10,9 @@ struct ColorTextureProgram {
 
 	GLuint program = 0;
 	//Attribute (per-vertex variable) locations:
-	GLuint Color_vec3 = -1U;
+	// vertex (location 0) - position in xy, texture coordinate in zw
 	//Uniform (per-invocation variable) locations:
+	GLuint Color_vec3 = -1U;
 	GLuint OBJECT_TO_CLIP_mat4 = -1U;
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
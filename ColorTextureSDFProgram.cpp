@@ -0,0 +1,54 @@
+#include "ColorTextureSDFProgram.hpp"
+
+#include "gl_compile_program.hpp"
+#include "gl_errors.hpp"
+
+Load< ColorTextureSDFProgram > color_texture_sdf_program(LoadTagEarly);
+
+ColorTextureSDFProgram::ColorTextureSDFProgram() {
+	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
+	program = gl_compile_program(
+		//vertex shader:
+		"#version 330 core\n"
+		"layout (location = 0) in vec4 vertex;\n"
+		"out vec2 TexCoords;\n"
+		"uniform mat4 projection;\n"
+		"void main() {\n"
+		"	gl_Position = projection * vec4(vertex.xy, 0.0, 1.0);\n"
+		"	TexCoords = vertex.zw;\n"
+		"}\n"
+	,
+		//fragment shader:
+		"#version 330 core\n"
+		"in vec2 TexCoords;\n"
+		"out vec4 color;\n"
+		"uniform sampler2D text;\n"
+		"uniform vec3 textColor;\n"
+		"void main() {\n"
+		//distance is 0.5 on the outline, larger inside:
+		"	float dist = texture(text, TexCoords).r;\n"
+		//antialias over about one screen pixel, whatever the scale:
+		"	float width = 0.7 * fwidth(dist);\n"
+		"	float alpha = smoothstep(0.5 - width, 0.5 + width, dist);\n"
+		"	color = vec4(textColor, alpha);\n"
+		"}\n"
+	);
+
+	//look up the locations of uniforms:
+	Color_vec3 = glGetUniformLocation(program, "textColor");
+	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "projection");
+
+	//set TEX to always refer to texture binding zero:
+	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
+
+	glUniform1i(glGetUniformLocation(program, "text"), 0);
+
+	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
+
+	GL_ERRORS();
+}
+
+ColorTextureSDFProgram::~ColorTextureSDFProgram() {
+	glDeleteProgram(program);
+	program = 0;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Load.hpp"
+
+//Shader program that draws text from a signed distance field glyph atlas, tinted with a uniform color:
+// (same inputs as ColorTextureProgram, so the two can share vertex arrays)
+struct ColorTextureSDFProgram {
+	ColorTextureSDFProgram();
+	~ColorTextureSDFProgram();
+
+	GLuint program = 0;
+	//Attribute (per-vertex variable) locations:
+	// vertex (location 0) - position in xy, texture coordinate in zw
+	//Uniform (per-invocation variable) locations:
+	GLuint Color_vec3 = -1U;
+	GLuint OBJECT_TO_CLIP_mat4 = -1U;
+	//Textures:
+	//TEXTURE0 - distance field (GlyphAtlas::DistanceField format) that is accessed by TexCoord
+};
+
+extern Load< ColorTextureSDFProgram > color_texture_sdf_program;
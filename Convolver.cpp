@@ -0,0 +1,174 @@
+#include "Convolver.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CONVOLVER_SSE2
+#include <emmintrin.h>
+#endif
+
+static constexpr uint32_t N = Convolver::FFTSize;
+static_assert((N & (N - 1)) == 0, "FFTSize must be a power of two.");
+
+//FFT tables, computed once:
+struct FFTTables {
+	std::array< uint32_t, N > bit_reverse;
+	//twiddle factors exp(-2 pi i k / (2 h)), k < h, for the stage with butterflies 'h' apart are stored starting at [h - 1]:
+	std::array< float, N > twiddle_re;
+	std::array< float, N > twiddle_im;
+};
+static FFTTables const tables = [](){
+	FFTTables t;
+	uint32_t bits = 0;
+	while ((1U << bits) < N) ++bits;
+	for (uint32_t k = 0; k < N; ++k) {
+		uint32_t r = 0;
+		for (uint32_t b = 0; b < bits; ++b) {
+			if (k & (1U << b)) r |= 1U << (bits - 1 - b);
+		}
+		t.bit_reverse[k] = r;
+	}
+	double const pi = 3.14159265358979323846;
+	for (uint32_t h = 1; h < N; h *= 2) {
+		for (uint32_t k = 0; k < h; ++k) {
+			double ang = -pi * double(k) / double(h);
+			t.twiddle_re[h - 1 + k] = float(std::cos(ang));
+			t.twiddle_im[h - 1 + k] = float(std::sin(ang));
+		}
+	}
+	t.twiddle_re[N - 1] = t.twiddle_im[N - 1] = 0.0f; //(unused)
+	return t;
+}();
+
+//in-place forward FFT of the N complex values (re[k], im[k]):
+// (the inverse FFT, times N, is fft(im, re) -- i.e., the forward transform with real and imaginary parts swapped)
+static void fft(float *re, float *im) {
+	for (uint32_t k = 0; k < N; ++k) {
+		uint32_t j = tables.bit_reverse[k];
+		if (j > k) {
+			std::swap(re[k], re[j]);
+			std::swap(im[k], im[j]);
+		}
+	}
+
+	for (uint32_t h = 1; h < N; h *= 2) {
+		float const *w_re = tables.twiddle_re.data() + (h - 1);
+		float const *w_im = tables.twiddle_im.data() + (h - 1);
+		for (uint32_t start = 0; start < N; start += 2 * h) {
+			float *a_re = re + start, *a_im = im + start;
+			float *b_re = a_re + h, *b_im = a_im + h;
+			uint32_t k = 0;
+		#ifdef CONVOLVER_SSE2
+			//four butterflies at a time (once stages are wide enough):
+			for (; k + 4 <= h; k += 4) {
+				__m128 wr = _mm_loadu_ps(w_re + k);
+				__m128 wi = _mm_loadu_ps(w_im + k);
+				__m128 br = _mm_loadu_ps(b_re + k);
+				__m128 bi = _mm_loadu_ps(b_im + k);
+				__m128 tr = _mm_sub_ps(_mm_mul_ps(wr, br), _mm_mul_ps(wi, bi));
+				__m128 ti = _mm_add_ps(_mm_mul_ps(wr, bi), _mm_mul_ps(wi, br));
+				__m128 ar = _mm_loadu_ps(a_re + k);
+				__m128 ai = _mm_loadu_ps(a_im + k);
+				_mm_storeu_ps(b_re + k, _mm_sub_ps(ar, tr));
+				_mm_storeu_ps(b_im + k, _mm_sub_ps(ai, ti));
+				_mm_storeu_ps(a_re + k, _mm_add_ps(ar, tr));
+				_mm_storeu_ps(a_im + k, _mm_add_ps(ai, ti));
+			}
+		#endif
+			for (; k < h; ++k) {
+				float tr = w_re[k] * b_re[k] - w_im[k] * b_im[k];
+				float ti = w_re[k] * b_im[k] + w_im[k] * b_re[k];
+				b_re[k] = a_re[k] - tr;
+				b_im[k] = a_im[k] - ti;
+				a_re[k] += tr;
+				a_im[k] += ti;
+			}
+		}
+	}
+}
+
+//helper: sum += x * h, for N complex values:
+static void multiply_add(float *sum_re, float *sum_im, float const *x_re, float const *x_im, float const *h_re, float const *h_im) {
+	uint32_t k = 0;
+#ifdef CONVOLVER_SSE2
+	for (; k + 4 <= N; k += 4) {
+		__m128 xr = _mm_loadu_ps(x_re + k);
+		__m128 xi = _mm_loadu_ps(x_im + k);
+		__m128 hr = _mm_loadu_ps(h_re + k);
+		__m128 hi = _mm_loadu_ps(h_im + k);
+		__m128 sr = _mm_loadu_ps(sum_re + k);
+		__m128 si = _mm_loadu_ps(sum_im + k);
+		sr = _mm_add_ps(sr, _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi)));
+		si = _mm_add_ps(si, _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr)));
+		_mm_storeu_ps(sum_re + k, sr);
+		_mm_storeu_ps(sum_im + k, si);
+	}
+#endif
+	for (; k < N; ++k) {
+		sum_re[k] += x_re[k] * h_re[k] - x_im[k] * h_im[k];
+		sum_im[k] += x_re[k] * h_im[k] + x_im[k] * h_re[k];
+	}
+}
+
+Convolver::Convolver(std::vector< float > const &impulse_response) {
+	partitions = std::max(1U, uint32_t((impulse_response.size() + BlockSize - 1) / BlockSize));
+
+	//transform each partition (zero-padded to FFTSize), folding in the 1/N that the inverse transform needs:
+	response.assign(size_t(partitions) * 2 * N, 0.0f);
+	for (uint32_t p = 0; p < partitions; ++p) {
+		float *re = response.data() + size_t(p) * 2 * N;
+		float *im = re + N;
+		size_t begin = size_t(p) * BlockSize;
+		size_t end = std::min(impulse_response.size(), begin + BlockSize);
+		for (size_t i = begin; i < end; ++i) {
+			re[i - begin] = impulse_response[i] / float(N);
+		}
+		fft(re, im);
+	}
+
+	history.assign(size_t(partitions) * 2 * N, 0.0f);
+	last.assign(2 * BlockSize, 0.0f);
+	sum.assign(2 * N, 0.0f);
+}
+
+void Convolver::process(float const *input, float *output) {
+	assert(input);
+	assert(output);
+
+	//once the input has been silent for long enough, every window in the history is silent too, so there is nothing to add:
+	bool silent = std::all_of(input, input + 2 * BlockSize, [](float x) { return x == 0.0f; });
+	silent_blocks = (silent ? silent_blocks + 1 : 0);
+	if (silent_blocks > partitions + 1) return;
+
+	//the new window (previous block, then this one; left as real and right as imaginary parts) replaces the oldest in the history:
+	newest = (newest + 1) % partitions;
+	float *x_re = history.data() + size_t(newest) * 2 * N;
+	float *x_im = x_re + N;
+	std::copy(last.begin(), last.begin() + BlockSize, x_re);
+	std::copy(last.begin() + BlockSize, last.end(), x_im);
+	for (uint32_t k = 0; k < BlockSize; ++k) {
+		x_re[BlockSize + k] = last[k] = input[2 * k];
+		x_im[BlockSize + k] = last[BlockSize + k] = input[2 * k + 1];
+	}
+	fft(x_re, x_im);
+
+	//output spectrum -- each partition of the response times the window from that many blocks ago:
+	float *sum_re = sum.data();
+	float *sum_im = sum_re + N;
+	std::fill(sum.begin(), sum.end(), 0.0f);
+	for (uint32_t p = 0; p < partitions; ++p) {
+		float const *h_re = response.data() + size_t(p) * 2 * N;
+		float const *w_re = history.data() + size_t((newest + partitions - p) % partitions) * 2 * N;
+		multiply_add(sum_re, sum_im, w_re, w_re + N, h_re, h_re + N);
+	}
+
+	//back to the time domain; the first half of the window wrapped around (circular convolution), so only the second half is kept:
+	fft(sum_im, sum_re);
+	for (uint32_t k = 0; k < BlockSize; ++k) {
+		output[2 * k] += sum_re[BlockSize + k];
+		output[2 * k + 1] += sum_im[BlockSize + k];
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * A Convolver convolves a stereo signal with a (mono) impulse response, one
+ * block at a time, using uniformly-partitioned overlap-save FFT convolution:
+ *
+ *  - the impulse response is cut into BlockSize-long partitions, and each is
+ *    zero-padded to FFTSize and transformed once, up front;
+ *  - each block of input is transformed (along with the block before it) and
+ *    kept in a delay line of the last 'partitions' input spectra;
+ *  - the output spectrum is the sum of each partition's spectrum times the
+ *    spectrum of the input from that many blocks ago, and the second half of
+ *    its inverse transform is the output block.
+ *
+ * So each block costs two FFTs plus one complex multiply-add per spectrum bin
+ * per partition -- a fixed amount of work that grows linearly (and slowly)
+ * with the impulse response's length, and there is no added latency.
+ *
+ * Both channels share one transform: left is the real part and right the
+ * imaginary part of the signal, which works because the impulse response is
+ * real.
+ *
+ * Usage:
+ *   Convolver convolver(impulse_response); //(at the output sampling rate)
+ *   convolver.process(input, output); //adds the next block of wet signal to output
+ *
+ */
+
+#include <vector>
+#include <cstdint>
+
+struct Convolver {
+	//stereo frames per block (and per partition of the impulse response):
+	static constexpr uint32_t BlockSize = 1024;
+	static constexpr uint32_t FFTSize = 2 * BlockSize;
+
+	Convolver(std::vector< float > const &impulse_response);
+
+	//convolve the next block of 'input' and add the result to 'output':
+	// (both are BlockSize frames of interleaved left/right floats)
+	void process(float const *input, float *output);
+
+	uint32_t partitions = 0; //impulse response length in blocks (at least one)
+
+	//internals:
+	//complex values are stored as FFTSize real parts followed by FFTSize imaginary parts:
+	std::vector< float > response; //spectra of the impulse response's partitions
+	std::vector< float > history; //spectra of the last 'partitions' windows (previous + current input block), as a ring
+	uint32_t newest = 0; //index in 'history' of the most recent window
+	std::vector< float > last; //previous input block (BlockSize left values, then BlockSize right values)
+	std::vector< float > sum; //scratch: output spectrum, then output (time domain)
+	uint32_t silent_blocks = 0; //input blocks in a row that were all zero (once the whole history is silent, blocks are skipped)
+};
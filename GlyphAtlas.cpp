@@ -0,0 +1,441 @@
+#include "GlyphAtlas.hpp"
+#include "GlyphRasterizer.hpp"
+
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+GlyphAtlas::GlyphAtlas(FT_Face face_, uint32_t pixel_size_, Format format_) : face(face_), pixel_size(pixel_size_), format(format_) {
+	assert(face);
+	//set size to load glyphs as:
+	if (FT_Set_Pixel_Sizes(face, 0, pixel_size)) {
+		throw std::runtime_error("GlyphAtlas: failed to set pixel size " + std::to_string(pixel_size) + ".");
+	}
+}
+
+GlyphAtlas::~GlyphAtlas() {
+	for (auto &page : pages) {
+		glDeleteTextures(1, &page.texture);
+		page.texture = 0;
+	}
+}
+
+GlyphAtlas::Glyph GlyphAtlas::lookup(uint32_t glyph_index) {
+	{ //already in the atlas?
+		auto f = glyphs.find(glyph_index);
+		if (f != glyphs.end()) {
+			pages[f->second.page].used_frame = frame;
+			return f->second;
+		}
+	}
+
+	Bitmap bitmap;
+	//use the background rasterizer's result if it has one; otherwise rasterize now:
+	if (!(rasterizer && rasterizer->take(glyph_index, &bitmap))) {
+		rasterize(face, glyph_index, pixel_size, format, &bitmap);
+	}
+	return insert(glyph_index, bitmap);
+}
+
+GlyphAtlas::Glyph GlyphAtlas::insert(uint32_t glyph_index, Bitmap const &bitmap) {
+	Glyph glyph = bitmap.glyph;
+	glyph.page = 0;
+	glyph.position = glm::uvec2(0);
+
+	if (glyph.size.x > 0 && glyph.size.y > 0) {
+		glm::uvec2 stored = glm::uvec2(glyph.size + 2 * glyph.spread);
+		assert(bitmap.pixels.size() == size_t(stored.x) * size_t(stored.y));
+
+		glm::uvec2 padded = stored + glm::uvec2(2 * Padding);
+
+		//glyphs that can't fit on even the largest page are stored empty (they still advance the pen):
+		if (padded.x > MaxPageSize || padded.y > MaxPageSize) {
+			std::cerr << "WARNING: glyph " << glyph_index << " (" << stored.x << "x" << stored.y << " texels) is too big for a " << MaxPageSize << "x" << MaxPageSize << " GlyphAtlas page; it will not be drawn." << std::endl;
+			glyph.size = glm::ivec2(0);
+			glyphs[glyph_index] = glyph;
+			return glyph;
+		}
+
+		//find space for the glyph, making more space if needed:
+		bool placed = false;
+		while (!placed) {
+			//try every page that has room:
+			for (uint32_t p = 0; p < pages.size() && !placed; ++p) {
+				if (allocate(pages[p], padded, &glyph.position)) {
+					glyph.page = p;
+					placed = true;
+				}
+			}
+			if (placed) break;
+
+			//try growing a page:
+			auto grow_page = std::find_if(pages.begin(), pages.end(), [](Page const &page) {
+				return page.size < MaxPageSize;
+			});
+			if (grow_page != pages.end()) {
+				grow(*grow_page);
+				continue;
+			}
+
+			//try opening a new page:
+			if (pages.size() < MaxPages) {
+				open_page();
+				continue;
+			}
+
+			//try evicting a page that isn't in use this frame:
+			if (evict_page()) continue;
+
+			//all pages are in use this frame, so go over budget:
+			std::cerr << "WARNING: GlyphAtlas has more than " << MaxPages << " full pages in use this frame." << std::endl;
+			open_page();
+		}
+		glm::uvec2 corner = glyph.position + glm::uvec2(Padding);
+		glyph.position = corner + glm::uvec2(glyph.spread);
+
+		//copy glyph into page's pixels:
+		Page &page = pages[glyph.page];
+		for (uint32_t row = 0; row < stored.y; ++row) {
+			uint8_t const *src = bitmap.pixels.data() + row * stored.x;
+			uint8_t *dst = page.pixels.data() + (corner.y + row) * page.size + corner.x;
+			std::copy(src, src + stored.x, dst);
+		}
+
+		//upload just the glyph's rectangle:
+		glBindTexture(GL_TEXTURE_2D, page.texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, page.size);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, corner.x);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, corner.y);
+		glTexSubImage2D(GL_TEXTURE_2D, 0,
+			corner.x, corner.y, stored.x, stored.y,
+			GL_RED, GL_UNSIGNED_BYTE, page.pixels.data());
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		page.used_frame = frame;
+	}
+
+	glyphs[glyph_index] = glyph;
+	return glyph;
+}
+
+//------------------------ rasterization --------------------------------
+
+//floor / ceiling of a / b for b > 0 (with correct rounding for negative a):
+static int32_t floor_div(int32_t a, int32_t b) {
+	return (a >= 0 ? a / b : -((-a + b - 1) / b));
+}
+static int32_t ceil_div(int32_t a, int32_t b) {
+	return -floor_div(-a, b);
+}
+
+//squared euclidean distance transform of a row or column, following
+// Felzenszwalb and Huttenlocher, "Distance Transforms of Sampled Functions":
+// on input, f[i] is 0 at feature samples and a large value elsewhere;
+// on output, d[i * stride] is the squared distance to the nearest feature sample.
+static void distance_transform_1d(std::vector< float > const &f, float *d, uint32_t stride, std::vector< uint32_t > &v, std::vector< float > &z) {
+	uint32_t n = uint32_t(f.size());
+	v.resize(n);
+	z.resize(n + 1);
+
+	//lower envelope of parabolas rooted at each sample:
+	uint32_t k = 0;
+	v[0] = 0;
+	z[0] = -std::numeric_limits< float >::infinity();
+	z[1] = std::numeric_limits< float >::infinity();
+	for (uint32_t q = 1; q < n; ++q) {
+		auto intersect = [&](uint32_t r) {
+			return ((f[q] + float(q) * float(q)) - (f[r] + float(r) * float(r))) / (2.0f * float(q) - 2.0f * float(r));
+		};
+		float s = intersect(v[k]);
+		while (s <= z[k]) { //(z[0] is -infinity, so this stops at k == 0)
+			k -= 1;
+			s = intersect(v[k]);
+		}
+		k += 1;
+		v[k] = q;
+		z[k] = s;
+		z[k+1] = std::numeric_limits< float >::infinity();
+	}
+
+	//read off the envelope:
+	k = 0;
+	for (uint32_t q = 0; q < n; ++q) {
+		while (z[k+1] < float(q)) k += 1;
+		float dq = float(q) - float(v[k]);
+		d[q * stride] = dq * dq + f[v[k]];
+	}
+}
+
+//squared distance from every sample of a w x h grid to the nearest sample where 'feature' is set:
+static void distance_transform(std::vector< bool > const &feature, uint32_t w, uint32_t h, std::vector< float > *distance_) {
+	assert(distance_);
+	auto &distance = *distance_;
+	assert(feature.size() == size_t(w) * size_t(h));
+
+	//(large enough to be "infinite" but small enough to not overflow when squared sums are formed)
+	float const Far = float(w) * float(w) + float(h) * float(h);
+
+	distance.resize(feature.size());
+	std::vector< float > f;
+	std::vector< uint32_t > v;
+	std::vector< float > z;
+
+	//columns:
+	f.resize(h);
+	for (uint32_t x = 0; x < w; ++x) {
+		for (uint32_t y = 0; y < h; ++y) {
+			f[y] = (feature[y * w + x] ? 0.0f : Far);
+		}
+		distance_transform_1d(f, distance.data() + x, w, v, z);
+	}
+
+	//rows:
+	f.resize(w);
+	for (uint32_t y = 0; y < h; ++y) {
+		std::copy(distance.begin() + y * w, distance.begin() + (y + 1) * w, f.begin());
+		distance_transform_1d(f, distance.data() + y * w, 1, v, z);
+	}
+}
+
+void GlyphAtlas::rasterize(FT_Face face, uint32_t glyph_index, uint32_t pixel_size, Format format, Bitmap *bitmap_) {
+	assert(bitmap_);
+	auto &out = *bitmap_;
+
+	//distance fields are computed from a larger bitmap:
+	uint32_t const oversample = (format == DistanceField ? uint32_t(SDFOversample) : 1);
+	uint32_t const load_size = pixel_size * oversample;
+
+	//(the face's size may have been changed by someone else, e.g. for shaping at another size)
+	if (face->size == nullptr || face->size->metrics.y_ppem != load_size) {
+		if (FT_Set_Pixel_Sizes(face, 0, load_size)) {
+			throw std::runtime_error("GlyphAtlas: failed to set pixel size " + std::to_string(load_size) + ".");
+		}
+	}
+	if (FT_Load_Glyph(face, glyph_index, FT_LOAD_RENDER)) {
+		throw std::runtime_error("GlyphAtlas: failed to load glyph " + std::to_string(glyph_index) + ".");
+	}
+	FT_GlyphSlot slot = face->glyph;
+	FT_Bitmap const &bitmap = slot->bitmap;
+
+	out.glyph = Glyph();
+	out.glyph.advance = int32_t(slot->advance.x) / int32_t(oversample);
+	out.pixels.clear();
+
+	if (bitmap.width == 0 || bitmap.rows == 0) return;
+
+	if (format == Coverage) {
+		out.glyph.size = glm::ivec2(bitmap.width, bitmap.rows);
+		out.glyph.bearing = glm::ivec2(slot->bitmap_left, slot->bitmap_top);
+		out.pixels.resize(bitmap.width * bitmap.rows);
+		for (uint32_t row = 0; row < bitmap.rows; ++row) {
+			uint8_t const *src = bitmap.buffer + int32_t(row) * bitmap.pitch;
+			std::copy(src, src + bitmap.width, out.pixels.begin() + row * bitmap.width);
+		}
+		return;
+	}
+
+	assert(format == DistanceField);
+	int32_t const os = int32_t(oversample);
+	int32_t const spread = int32_t(SDFSpread);
+
+	//glyph rectangle at atlas resolution, snapped outward to whole texels:
+	int32_t left = floor_div(slot->bitmap_left, os);
+	int32_t top = ceil_div(slot->bitmap_top, os);
+	int32_t offset_x = slot->bitmap_left - left * os; //oversampled bitmap's offset within the snapped rectangle
+	int32_t offset_y = top * os - slot->bitmap_top;
+	out.glyph.size = glm::ivec2(
+		ceil_div(offset_x + int32_t(bitmap.width), os),
+		ceil_div(offset_y + int32_t(bitmap.rows), os)
+	);
+	out.glyph.bearing = glm::ivec2(left, top);
+	out.glyph.spread = spread;
+
+	//oversampled grid covering the glyph and its spread:
+	glm::ivec2 stored = out.glyph.size + 2 * spread;
+	uint32_t gw = uint32_t(stored.x * os);
+	uint32_t gh = uint32_t(stored.y * os);
+	std::vector< bool > inside(gw * gh, false);
+	for (uint32_t row = 0; row < bitmap.rows; ++row) {
+		uint8_t const *src = bitmap.buffer + int32_t(row) * bitmap.pitch;
+		uint32_t gy = uint32_t(spread * os + offset_y) + row;
+		for (uint32_t col = 0; col < bitmap.width; ++col) {
+			uint32_t gx = uint32_t(spread * os + offset_x) + col;
+			inside[gy * gw + gx] = (src[col] >= 128);
+		}
+	}
+	std::vector< bool > outside(inside.size());
+	for (uint32_t i = 0; i < inside.size(); ++i) {
+		outside[i] = !inside[i];
+	}
+
+	std::vector< float > to_inside, to_outside;
+	distance_transform(inside, gw, gh, &to_inside);
+	distance_transform(outside, gw, gh, &to_outside);
+
+	//average signed distance over each texel's samples, then map [-spread,spread] texels to [0,255]:
+	out.pixels.resize(size_t(stored.x) * size_t(stored.y));
+	float const inv_samples = 1.0f / float(os * os);
+	for (int32_t ty = 0; ty < stored.y; ++ty) {
+		for (int32_t tx = 0; tx < stored.x; ++tx) {
+			float sum = 0.0f;
+			for (int32_t sy = ty * os; sy < (ty + 1) * os; ++sy) {
+				for (int32_t sx = tx * os; sx < (tx + 1) * os; ++sx) {
+					uint32_t i = uint32_t(sy) * gw + uint32_t(sx);
+					//(the outline lies halfway between an inside and an outside sample)
+					if (inside[i]) sum += std::sqrt(to_outside[i]) - 0.5f;
+					else sum -= std::sqrt(to_inside[i]) - 0.5f;
+				}
+			}
+			float dist = sum * inv_samples / float(os); //in texels, positive inside
+			float value = 0.5f + 0.5f * dist / float(spread);
+			out.pixels[size_t(ty) * size_t(stored.x) + size_t(tx)] = uint8_t(std::round(255.0f * std::max(0.0f, std::min(1.0f, value))));
+		}
+	}
+}
+
+glm::vec2 GlyphAtlas::tex_min(Glyph const &glyph) const {
+	assert(glyph.page < pages.size());
+	return glm::vec2(glyph.position) / float(pages[glyph.page].size);
+}
+
+glm::vec2 GlyphAtlas::tex_max(Glyph const &glyph) const {
+	assert(glyph.page < pages.size());
+	return glm::vec2(glyph.position + glm::uvec2(glyph.size)) / float(pages[glyph.page].size);
+}
+
+void GlyphAtlas::new_frame() {
+	//(uploading before advancing the frame means that pages drawn last frame won't be evicted to make room)
+	if (rasterizer) upload_rasterized();
+	frame += 1;
+}
+
+void GlyphAtlas::upload_rasterized() {
+	assert(rasterizer);
+	std::vector< std::pair< uint32_t, Bitmap > > finished;
+	rasterizer->take_all(&finished);
+	for (auto const &f : finished) {
+		if (glyphs.count(f.first)) continue; //(already rasterized by lookup() in the meantime)
+		insert(f.first, f.second);
+	}
+}
+
+void GlyphAtlas::touch(uint32_t page) {
+	assert(page < pages.size());
+	pages[page].used_frame = frame;
+}
+
+//------------------------ internals --------------------------------
+
+bool GlyphAtlas::allocate(Page &page, glm::uvec2 const &size, glm::uvec2 *position) {
+	assert(position);
+
+	//best fit: the shortest shelf that the glyph fits on:
+	Shelf *best = nullptr;
+	for (auto &shelf : page.shelves) {
+		if (shelf.height < size.y) continue;
+		if (shelf.x + size.x > page.size) continue;
+		if (best == nullptr || shelf.height < best->height) best = &shelf;
+	}
+
+	//don't waste a tall shelf on a short glyph if a new shelf would fit it better:
+	uint32_t top = (page.shelves.empty() ? 0 : page.shelves.back().y + page.shelves.back().height);
+	uint32_t height = (size.y + 3) & ~3U; //a bit of slack so similar glyphs share shelves
+	if (best && best->height > 2 * height && top + height <= page.size) {
+		best = nullptr;
+	}
+
+	if (!best) {
+		//open a new shelf:
+		if (top + size.y > page.size || size.x > page.size) return false;
+		page.shelves.emplace_back();
+		best = &page.shelves.back();
+		best->y = top;
+		best->height = std::min(height, page.size - top);
+		best->x = 0;
+	}
+
+	*position = glm::uvec2(best->x, best->y);
+	best->x += size.x;
+	return true;
+}
+
+void GlyphAtlas::grow(Page &page) {
+	assert(page.size < MaxPageSize);
+	uint32_t new_size = page.size * 2;
+
+	//shelves stay where they are; the new space is to the right and below:
+	std::vector< uint8_t > new_pixels(new_size * new_size, 0);
+	for (uint32_t row = 0; row < page.size; ++row) {
+		std::copy(page.pixels.begin() + row * page.size, page.pixels.begin() + (row + 1) * page.size, new_pixels.begin() + row * new_size);
+	}
+	page.pixels = std::move(new_pixels);
+	page.size = new_size;
+
+	upload(page);
+}
+
+void GlyphAtlas::open_page() {
+	pages.emplace_back();
+	Page &page = pages.back();
+	page.size = InitialPageSize;
+	page.pixels.assign(page.size * page.size, 0);
+	page.used_frame = frame;
+
+	glGenTextures(1, &page.texture);
+	glBindTexture(GL_TEXTURE_2D, page.texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	upload(page);
+}
+
+bool GlyphAtlas::evict_page() {
+	//find least-recently-used page that wasn't used this frame:
+	uint32_t victim = -1U;
+	for (uint32_t p = 0; p < pages.size(); ++p) {
+		if (pages[p].used_frame == frame) continue;
+		if (victim == -1U || pages[p].used_frame < pages[victim].used_frame) victim = p;
+	}
+	if (victim == -1U) return false;
+
+	//forget all glyphs on the page:
+	for (auto gi = glyphs.begin(); gi != glyphs.end(); /* later */) {
+		if (gi->second.page == victim && gi->second.size.x > 0 && gi->second.size.y > 0) {
+			gi = glyphs.erase(gi);
+		} else {
+			++gi;
+		}
+	}
+
+	Page &page = pages[victim];
+	page.shelves.clear();
+	page.evictions += 1;
+	std::fill(page.pixels.begin(), page.pixels.end(), uint8_t(0));
+	page.used_frame = frame;
+	upload(page);
+
+	return true;
+}
+
+void GlyphAtlas::upload(Page &page) {
+	glBindTexture(GL_TEXTURE_2D, page.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, page.size, page.size, 0, GL_RED, GL_UNSIGNED_BYTE, page.pixels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GL_ERRORS();
+}
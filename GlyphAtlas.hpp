@@ -0,0 +1,149 @@
+#pragma once
+
+/*
+ * A GlyphAtlas packs rasterized glyphs from a FreeType face into a small
+ * number of shared single-channel textures ("pages").
+ *
+ * Glyphs are packed into horizontal shelves; when a page fills up it is
+ * grown (up to MaxPageSize), then additional pages are opened (up to
+ * MaxPages), and finally the least-recently-used page is evicted.
+ *
+ * Pages store either plain coverage (Coverage format; draw with
+ * color_texture_program) or a signed distance field (DistanceField format;
+ * draw with color_texture_sdf_program). Distance field glyphs are generated
+ * from an oversampled bitmap when they are first packed, and stay sharp at
+ * any scale, so a single atlas serves every window size.
+ *
+ * Usage:
+ *   GlyphAtlas atlas(face, 48);
+ *   //at the start of each frame:
+ *   atlas.new_frame();
+ *   //when drawing:
+ *   GlyphAtlas::Glyph glyph = atlas.lookup(glyph_index); //glyph_index from hb_shape
+ *   glBindTexture(GL_TEXTURE_2D, atlas.pages[glyph.page].texture);
+ *
+ */
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+struct GlyphRasterizer;
+
+struct GlyphAtlas {
+	//what page texels mean:
+	enum Format : uint8_t {
+		Coverage, //glyph coverage, 0 (empty) - 255 (covered)
+		DistanceField, //signed distance to glyph outline; 128 is on the outline, larger values are inside
+	};
+
+	//the atlas rasterizes glyphs from 'face' at 'pixel_size' pixels:
+	// (face must outlive the atlas)
+	GlyphAtlas(FT_Face face, uint32_t pixel_size, Format format = Coverage);
+	~GlyphAtlas();
+
+	//pages are GL textures, so copying an atlas is not advised:
+	GlyphAtlas(GlyphAtlas const &) = delete;
+
+	//page size limits:
+	enum : uint32_t {
+		InitialPageSize = 256, //new pages start this wide/tall...
+		MaxPageSize = 2048, //...and are doubled until they are this wide/tall
+		MaxPages = 4, //after this many full pages, the least-recently-used page is evicted
+		Padding = 1, //empty texels around each glyph (avoids bleeding when filtering)
+	};
+
+	//distance field parameters:
+	enum : uint32_t {
+		SDFOversample = 4, //distance fields are computed from bitmaps rasterized this many times larger...
+		SDFSpread = 4, //...and cover this many texels on either side of the outline
+	};
+
+	struct Glyph {
+		uint32_t page = 0; //index into 'pages'
+		glm::uvec2 position = glm::uvec2(0); //texel of glyph's top-left corner in page (rows are stored top-to-bottom, like FreeType bitmaps)
+		glm::ivec2 size = glm::ivec2(0); //size of glyph bitmap (pixels)
+		glm::ivec2 bearing = glm::ivec2(0); //offset from baseline to left/top of glyph
+		int32_t advance = 0; //horizontal advance (1/64ths of a pixel)
+		int32_t spread = 0; //extra texels stored on every side of the glyph (distance field falloff; 0 for Coverage)
+	};
+
+	//a glyph rasterized into CPU memory, ready to be packed:
+	struct Bitmap {
+		Glyph glyph; //(page and position are not yet meaningful)
+		std::vector< uint8_t > pixels; //(size + 2 * spread) texels wide and tall, rows top-to-bottom
+	};
+
+	//rasterize a glyph without touching any GL state:
+	// (sets the pixel size of 'face', so 'face' must not be in use elsewhere at the same time)
+	static void rasterize(FT_Face face, uint32_t glyph_index, uint32_t pixel_size, Format format, Bitmap *bitmap);
+
+	//get the glyph with index 'glyph_index' (as returned by hb_shape),
+	// rasterizing and packing it if it isn't already in the atlas:
+	//NOTE: may evict a page that was not used this frame, so hang on to the page's
+	// texture only for the duration of a frame.
+	Glyph lookup(uint32_t glyph_index);
+
+	//pack (and upload) an already-rasterized glyph:
+	Glyph insert(uint32_t glyph_index, Bitmap const &bitmap);
+
+	//texture coordinates of the corners of a glyph in its page:
+	// (tex_min is at the top-left of the glyph bitmap, tex_max at the bottom-right)
+	glm::vec2 tex_min(Glyph const &glyph) const;
+	glm::vec2 tex_max(Glyph const &glyph) const;
+
+	//advance the frame counter used to decide which pages are safe to evict:
+	// (also uploads any glyphs that 'rasterizer' has finished)
+	void new_frame();
+
+	//optional background rasterizer (for the same font, size, and format as the atlas):
+	// finished glyphs are uploaded in new_frame() and lookup() uses them instead of rasterizing
+	GlyphRasterizer *rasterizer = nullptr;
+
+	//pack all glyphs that 'rasterizer' has finished:
+	void upload_rasterized();
+
+	//mark a page as in use this frame without looking up a glyph on it:
+	// (for code that retains glyph positions across frames, like TextLayout)
+	void touch(uint32_t page);
+
+	//-- internals --
+
+	FT_Face face;
+	uint32_t pixel_size;
+	Format format;
+
+	struct Shelf {
+		uint32_t y = 0; //first row of shelf
+		uint32_t height = 0; //height of tallest glyph slot on shelf
+		uint32_t x = 0; //next free column on shelf
+	};
+
+	struct Page {
+		GLuint texture = 0;
+		uint32_t size = 0; //pages are square
+		std::vector< uint8_t > pixels; //CPU copy of texture contents (used when growing)
+		std::vector< Shelf > shelves;
+		uint32_t used_frame = 0; //last frame in which a glyph on the page was looked up
+		uint32_t evictions = 0; //incremented every time the page is cleared; retained glyph positions are stale if this changes
+	};
+	std::vector< Page > pages;
+
+	std::unordered_map< uint32_t, Glyph > glyphs;
+
+	uint32_t frame = 0;
+
+	//helpers:
+	bool allocate(Page &page, glm::uvec2 const &size, glm::uvec2 *position);
+	void grow(Page &page);
+	void open_page();
+	bool evict_page();
+	void upload(Page &page);
+};
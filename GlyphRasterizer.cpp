@@ -0,0 +1,157 @@
+#include "GlyphRasterizer.hpp"
+
+#include <hb-ft.h>
+
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+GlyphRasterizer::GlyphRasterizer(std::string const &font_path, uint32_t pixel_size_, GlyphAtlas::Format format_) : pixel_size(pixel_size_), format(format_) {
+	if (FT_Init_FreeType(&library)) {
+		throw std::runtime_error("GlyphRasterizer: failed to initialize FreeType.");
+	}
+	if (FT_New_Face(library, font_path.c_str(), 0, &face)) {
+		FT_Done_FreeType(library);
+		throw std::runtime_error("GlyphRasterizer: failed to load font '" + font_path + "'.");
+	}
+	if (FT_Set_Pixel_Sizes(face, 0, pixel_size)) {
+		FT_Done_Face(face);
+		FT_Done_FreeType(library);
+		throw std::runtime_error("GlyphRasterizer: failed to set pixel size " + std::to_string(pixel_size) + ".");
+	}
+	font = hb_ft_font_create_referenced(face);
+	buffer = hb_buffer_create();
+
+	worker = std::thread(&GlyphRasterizer::run, this);
+}
+
+GlyphRasterizer::~GlyphRasterizer() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	worker.join();
+
+	hb_buffer_destroy(buffer);
+	buffer = nullptr;
+	hb_font_destroy(font);
+	font = nullptr;
+	FT_Done_Face(face);
+	face = nullptr;
+	FT_Done_FreeType(library);
+	library = nullptr;
+}
+
+void GlyphRasterizer::prewarm(std::string const &text) {
+	if (text.empty()) return;
+	Job job;
+	job.text = text;
+	push(std::move(job));
+}
+
+void GlyphRasterizer::prewarm(uint32_t first_codepoint, uint32_t last_codepoint) {
+	if (first_codepoint > last_codepoint) return;
+	Job job;
+	job.first_codepoint = first_codepoint;
+	job.last_codepoint = last_codepoint;
+	push(std::move(job));
+}
+
+bool GlyphRasterizer::take(uint32_t glyph_index, GlyphAtlas::Bitmap *bitmap) {
+	assert(bitmap);
+	std::unique_lock< std::mutex > lock(mutex);
+	auto f = finished.find(glyph_index);
+	if (f == finished.end()) return false;
+	*bitmap = std::move(f->second);
+	finished.erase(f);
+	return true;
+}
+
+void GlyphRasterizer::take_all(std::vector< std::pair< uint32_t, GlyphAtlas::Bitmap > > *finished_) {
+	assert(finished_);
+	std::unique_lock< std::mutex > lock(mutex);
+	finished_->reserve(finished_->size() + finished.size());
+	for (auto &f : finished) {
+		finished_->emplace_back(f.first, std::move(f.second));
+	}
+	finished.clear();
+}
+
+bool GlyphRasterizer::idle() {
+	std::unique_lock< std::mutex > lock(mutex);
+	return jobs.empty() && !working;
+}
+
+void GlyphRasterizer::push(Job &&job) {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		jobs.emplace_back(std::move(job));
+	}
+	wake.notify_one();
+}
+
+void GlyphRasterizer::run() {
+	while (true) {
+		Job job;
+		{ //wait for a job (or for quit):
+			std::unique_lock< std::mutex > lock(mutex);
+			working = false;
+			wake.wait(lock, [this](){ return quit || !jobs.empty(); });
+			if (quit) return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			working = true;
+		}
+
+		//figure out which glyphs the job needs:
+		std::vector< uint32_t > glyph_indices;
+		if (!job.text.empty()) {
+			size_t begin = 0;
+			while (begin < job.text.size()) {
+				size_t end = job.text.find('\n', begin);
+				if (end == std::string::npos) end = job.text.size();
+				if (end > begin) {
+					hb_buffer_reset(buffer);
+					hb_buffer_add_utf8(buffer, job.text.c_str() + begin, int(end - begin), 0, int(end - begin));
+					hb_buffer_guess_segment_properties(buffer);
+					hb_shape(font, buffer, nullptr, 0);
+
+					unsigned int len = hb_buffer_get_length(buffer);
+					hb_glyph_info_t *info = hb_buffer_get_glyph_infos(buffer, nullptr);
+					for (unsigned int i = 0; i < len; ++i) {
+						glyph_indices.emplace_back(info[i].codepoint); //(after shaping, 'codepoint' holds the glyph index)
+					}
+				}
+				begin = end + 1;
+			}
+		} else {
+			for (uint32_t c = job.first_codepoint; c <= job.last_codepoint; ++c) {
+				FT_UInt glyph_index = FT_Get_Char_Index(face, c);
+				if (glyph_index != 0) glyph_indices.emplace_back(glyph_index);
+				if (c == job.last_codepoint) break; //(in case last_codepoint is the largest uint32_t)
+			}
+		}
+
+		rasterize(glyph_indices);
+	}
+}
+
+void GlyphRasterizer::rasterize(std::vector< uint32_t > const &glyph_indices) {
+	for (uint32_t glyph_index : glyph_indices) {
+		if (!queued_glyphs.insert(glyph_index).second) continue; //already done
+
+		GlyphAtlas::Bitmap bitmap;
+		try {
+			GlyphAtlas::rasterize(face, glyph_index, pixel_size, format, &bitmap);
+		} catch (std::exception &e) {
+			//(the atlas will try again -- and report the problem -- if the glyph is ever drawn)
+			std::cerr << "WARNING: GlyphRasterizer: " << e.what() << std::endl;
+			continue;
+		}
+
+		std::unique_lock< std::mutex > lock(mutex);
+		if (quit) return;
+		finished.emplace(glyph_index, std::move(bitmap));
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+/*
+ * A GlyphRasterizer renders glyphs on a worker thread, so that a GlyphAtlas
+ * only has to upload them (instead of rasterizing them in the middle of a
+ * frame the first time they are drawn).
+ *
+ * The worker opens its own FT_Face (FreeType faces may not be shared between
+ * threads) and shapes text with its own HarfBuzz font, so prewarmed text
+ * produces exactly the glyphs that TextLayout will later look up.
+ *
+ * Usage:
+ *   GlyphRasterizer rasterizer(data_path("font.ttf"), 48, GlyphAtlas::DistanceField);
+ *   atlas.rasterizer = &rasterizer; //atlas must use the same font, size, and format
+ *   rasterizer.prewarm("Some text\nthat will be drawn soon");
+ *   rasterizer.prewarm(0x20, 0x7e); //printable ASCII
+ *   //...GlyphAtlas::new_frame() uploads whatever is ready.
+ *
+ */
+
+#include "GlyphAtlas.hpp"
+
+#include <hb.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <cstdint>
+
+struct GlyphRasterizer {
+	//open 'font_path' and start the worker thread:
+	GlyphRasterizer(std::string const &font_path, uint32_t pixel_size, GlyphAtlas::Format format);
+	//stops the worker thread (abandoning any jobs that haven't started):
+	~GlyphRasterizer();
+
+	//owns a thread, so copying is not advised:
+	GlyphRasterizer(GlyphRasterizer const &) = delete;
+
+	//queue all glyphs needed to draw 'text' (shaped one '\n'-separated line at a time, like TextLayout):
+	void prewarm(std::string const &text);
+
+	//queue the glyphs for codepoints first_codepoint through last_codepoint (inclusive):
+	void prewarm(uint32_t first_codepoint, uint32_t last_codepoint);
+
+	//remove and return a finished glyph, if the worker has rasterized it:
+	bool take(uint32_t glyph_index, GlyphAtlas::Bitmap *bitmap);
+
+	//remove and return all finished glyphs:
+	void take_all(std::vector< std::pair< uint32_t, GlyphAtlas::Bitmap > > *finished);
+
+	//true if all queued jobs are done:
+	bool idle();
+
+	//-- internals --
+
+	uint32_t pixel_size;
+	GlyphAtlas::Format format;
+
+	//only used by the worker thread:
+	FT_Library library = nullptr;
+	FT_Face face = nullptr;
+	hb_font_t *font = nullptr;
+	hb_buffer_t *buffer = nullptr;
+	std::unordered_set< uint32_t > queued_glyphs; //glyphs already rasterized (or in progress)
+
+	//shared between threads; guarded by 'mutex':
+	struct Job {
+		std::string text; //if not empty, shape this text...
+		uint32_t first_codepoint = 0, last_codepoint = 0; //...otherwise, use this codepoint range
+	};
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque< Job > jobs;
+	bool working = false; //worker is currently running a job
+	bool quit = false;
+	std::unordered_map< uint32_t, GlyphAtlas::Bitmap > finished;
+
+	std::thread worker;
+
+	void push(Job &&job);
+	void run(); //worker thread body
+	void rasterize(std::vector< uint32_t > const &glyph_indices); //called on worker thread
+};
@@ -2,13 +2,20 @@
 
 #include "Scene.hpp"
 #include "Sound.hpp"
+#include "GlyphAtlas.hpp"
+#include "GlyphRasterizer.hpp"
+#include "TextBatch.hpp"
+#include "ShapeCache.hpp"
+#include "TextLayout.hpp"
+#include "Story.hpp"
+#include "StoryRules.hpp"
 
 #include <glm/glm.hpp>
 
+#include <array>
 #include <vector>
 #include <deque>
-
-enum StateType {DIALOGUE, CHOICE, EFFECT};
+#include <memory>
 
 struct PlayMode : Mode {
 	PlayMode();
@@ -19,73 +26,38 @@ struct PlayMode : Mode {
 	virtual void update(float elapsed) override;
 	virtual void draw(glm::uvec2 const &drawable_size) override;
 
-    void render_text(std::string text, float x, float y, float scale, glm::vec3 color, glm::uvec2 const &drawable_size);
-    float render_line(std::string text, float &start_x, float &start_y, float scale, glm::vec3 color, glm::uvec2 const &drawable_size);
+    // glyph textures shared by all rendered text
+    std::unique_ptr< GlyphAtlas > glyph_atlas;
+    // rasterizes story text for glyph_atlas ahead of time, on another thread
+    std::unique_ptr< GlyphRasterizer > glyph_rasterizer;
+    // HarfBuzz results for recently drawn lines
+    std::unique_ptr< ShapeCache > shape_cache;
+
+    // retained text on screen; only re-laid out when it changes
+    TextLayout body_layout;
+    TextLayout choice1_layout;
+    TextLayout choice2_layout;
+    TextLayout stats_layout;
+
+    // what the layouts currently show, so strings are only rebuilt on change
+    uint32_t shown_state_id = -1U;
+    bool shown_choice1_selected = true;
+    glm::ivec3 shown_stats = glm::ivec3(-1);
 	//----- game state -----
     bool up_pressed = false;
     bool down_pressed = false;
     bool enter_pressed = false;
 
-    struct Dialogue {
-        uint32_t id = 0;
-        std::string text;
-    };
-
-    struct ChoiceSelect {
-        float prob = 0.f;
-        uint32_t effect1_id = 0;
-        uint32_t effect2_id = 0;
-        std::string text;
-    };
-
-    struct Choice {
-        uint32_t id = 0;
-        std::string text;
-
-        ChoiceSelect choice1;
-        ChoiceSelect choice2;
-    };
-
-    struct Effect {
-        uint32_t id = 0;
-        std::string text;
-        int32_t academics = 0;
-        int32_t social = 0;
-        int32_t health = 0;
-    };
-    std::unordered_map<uint32_t, StateType> id_to_state_type;
-    std::unordered_map<uint32_t, Dialogue> dialogue_map;
-    std::unordered_map<uint32_t, Choice> choice_map;
-    std::unordered_map<uint32_t, Effect> effect_map;
-
-    void read_dialogue();
-    void read_choice();
-    void read_choice_select(std::ifstream &file, ChoiceSelect &choice);
-    void read_effect();
-
-    uint32_t PASS = 4;
-    uint32_t FAIL_ACADEMICS = 1;
-    uint32_t FAIL_SOCIAL = 2;
-    uint32_t FAIL_HEALTH = 3;
-
-    uint32_t story_line [25] = {
-    0, 
-    5, 0, 
-    33, 0,
-    9, 0, 
-    41, 0,
-    25, 0,
-    37, 0,
-    13, 0, 
-    29, 0,
-    21, 0, 
-    17, 0, 
-    PASS, FAIL_ACADEMICS, FAIL_SOCIAL, FAIL_HEALTH};
+    // the story (shared by all PlayModes; see Story.hpp):
+    Story const &story;
+
+    // node ids visited by this playthrough (see StoryRules.hpp):
+    std::array< uint32_t, StoryRules::Events > story_line = StoryRules::StoryLine;
     uint32_t current_event = 0;
 
-    int32_t academics = 100;
-    int32_t social = 100;
-    int32_t health = 100;
+    int32_t academics = StoryRules::StartStat;
+    int32_t social = StoryRules::StartStat;
+    int32_t health = StoryRules::StartStat;
 
     float align_left_x = 100.f;
     float dialogue_y_minus = 200.f;
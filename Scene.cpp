@@ -5,8 +5,15 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_CULL_SSE2
+#include <emmintrin.h>
+#endif
+
 //-------------------------
 
 glm::mat4x3 Scene::Transform::make_local_to_parent() const {
@@ -57,17 +64,75 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 }
 
 glm::mat4x3 Scene::Transform::make_local_to_world() const {
-	if (!parent) {
-		return make_local_to_parent();
-	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+	if (dirty & LocalToWorldDirty) {
+		if (!parent) {
+			local_to_world = make_local_to_parent();
+		} else {
+			local_to_world = parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		dirty &= ~LocalToWorldDirty;
 	}
+	return local_to_world;
 }
 glm::mat4x3 Scene::Transform::make_world_to_local() const {
-	if (!parent) {
-		return make_parent_to_local();
-	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+	if (dirty & WorldToLocalDirty) {
+		if (!parent) {
+			world_to_local = make_parent_to_local();
+		} else {
+			world_to_local = make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		dirty &= ~WorldToLocalDirty;
+	}
+	return world_to_local;
+}
+
+void Scene::Transform::set_position(glm::vec3 const &new_position) {
+	position = new_position;
+	mark_dirty();
+}
+
+void Scene::Transform::set_rotation(glm::quat const &new_rotation) {
+	rotation = new_rotation;
+	mark_dirty();
+}
+
+void Scene::Transform::set_scale(glm::vec3 const &new_scale) {
+	scale = new_scale;
+	mark_dirty();
+}
+
+void Scene::Transform::set_parent(Transform *new_parent) {
+	if (new_parent == parent) return;
+	if (parent) {
+		auto f = std::find(parent->children.begin(), parent->children.end(), this);
+		assert(f != parent->children.end());
+		parent->children.erase(f);
+	}
+	parent = new_parent;
+	if (parent) {
+		parent->children.emplace_back(this);
+	}
+	mark_dirty();
+}
+
+void Scene::Transform::mark_dirty() {
+	//descendants of a dirty transform are already dirty, so the walk can stop there:
+	if (dirty == (LocalToWorldDirty | WorldToLocalDirty)) return;
+	dirty = LocalToWorldDirty | WorldToLocalDirty;
+	for (Transform *child : children) {
+		child->mark_dirty();
+	}
+}
+
+Scene::Transform::~Transform() {
+	for (Transform *child : children) {
+		child->parent = nullptr;
+		child->mark_dirty();
+	}
+	if (parent) {
+		auto f = std::find(parent->children.begin(), parent->children.end(), this);
+		assert(f != parent->children.end());
+		parent->children.erase(f);
 	}
 }
 
@@ -80,6 +145,101 @@ glm::mat4 Scene::Camera::make_projection() const {
 //-------------------------
 
 
+void Scene::Drawable::make_world_bounds(glm::vec3 *center_, glm::vec3 *extent_) const {
+	assert(center_ && extent_);
+	assert(transform);
+	glm::mat4x3 const &to_world = transform->make_local_to_world();
+
+	glm::vec3 center = 0.5f * (max + min);
+	glm::vec3 extent = 0.5f * (max - min);
+
+	//the box's center just transforms as a point,
+	// and its (axis-aligned) extent along each world axis is the sum of its axes' (absolute) contributions:
+	*center_ = to_world * glm::vec4(center, 1.0f);
+	*extent_ = glm::abs(to_world[0]) * extent.x
+	         + glm::abs(to_world[1]) * extent.y
+	         + glm::abs(to_world[2]) * extent.z;
+}
+
+void Scene::make_frustum_planes(glm::mat4 const &world_to_clip, glm::vec4 (&planes)[6]) {
+	//clip-space tests (-w <= x <= w, etc) are sums and differences of the rows of world_to_clip:
+	// (n.b. with an infinite far plane, the last plane comes out as (0,0,0,+) and culls nothing)
+	glm::vec4 rows[4];
+	for (uint32_t r = 0; r < 4; ++r) {
+		rows[r] = glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+	}
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[3] + rows[2];
+	planes[5] = rows[3] - rows[2];
+}
+
+void Scene::cull(glm::mat4 const &world_to_clip, std::vector< bool > *visible_) const {
+	assert(visible_);
+	auto &visible = *visible_;
+	visible.assign(drawables.size(), true);
+
+	glm::vec4 planes[6];
+	make_frustum_planes(world_to_clip, planes);
+
+	//gather the world-space boxes of drawables that have bounds, four to a group:
+	cull_boxes.clear();
+	cull_indices.clear();
+	uint32_t index = 0;
+	for (auto const &drawable : drawables) {
+		if (drawable.has_bounds()) {
+			glm::vec3 center, extent;
+			drawable.make_world_bounds(&center, &extent);
+			uint32_t lane = uint32_t(cull_indices.size()) % 4;
+			if (lane == 0) cull_boxes.resize(cull_boxes.size() + 24, 0.0f);
+			float *group = cull_boxes.data() + cull_boxes.size() - 24;
+			group[ 0 + lane] = center.x;
+			group[ 4 + lane] = center.y;
+			group[ 8 + lane] = center.z;
+			group[12 + lane] = extent.x;
+			group[16 + lane] = extent.y;
+			group[20 + lane] = extent.z;
+			cull_indices.emplace_back(index);
+		}
+		++index;
+	}
+
+	//a box is outside if it is entirely behind any plane, i.e., if the signed distance of its center
+	// is less than minus the "radius" of the box along the plane's normal: dot(n, c) + d + dot(|n|, e) < 0
+	for (uint32_t g = 0; g * 4 < cull_indices.size(); ++g) {
+		float const *group = cull_boxes.data() + 24 * g;
+		uint32_t inside = 0xf; //bit per box
+	#ifdef SCENE_CULL_SSE2
+		__m128 cx = _mm_loadu_ps(group +  0), cy = _mm_loadu_ps(group +  4), cz = _mm_loadu_ps(group +  8);
+		__m128 ex = _mm_loadu_ps(group + 12), ey = _mm_loadu_ps(group + 16), ez = _mm_loadu_ps(group + 20);
+		for (auto const &plane : planes) {
+			__m128 dist = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w))
+			);
+			__m128 radius = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), ex), _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), ey)),
+				_mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), ez)
+			);
+			inside &= uint32_t(_mm_movemask_ps(_mm_cmpge_ps(_mm_add_ps(dist, radius), _mm_setzero_ps())));
+		}
+	#else
+		for (uint32_t lane = 0; lane < 4; ++lane) {
+			for (auto const &plane : planes) {
+				float dist = plane.x * group[0 + lane] + plane.y * group[4 + lane] + plane.z * group[8 + lane] + plane.w;
+				float radius = std::abs(plane.x) * group[12 + lane] + std::abs(plane.y) * group[16 + lane] + std::abs(plane.z) * group[20 + lane];
+				if (!(dist + radius >= 0.0f)) inside &= ~(1U << lane);
+			}
+		}
+	#endif
+		for (uint32_t lane = 0; lane < 4 && g * 4 + lane < cull_indices.size(); ++lane) {
+			visible[cull_indices[g * 4 + lane]] = ((inside >> lane) & 1) != 0;
+		}
+	}
+}
+
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
 	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
@@ -89,8 +249,25 @@ void Scene::draw(Camera const &camera) const {
 
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
 
-	//Iterate through all drawables, sending each one to OpenGL:
+	//Find drawables that might be on screen (before touching any OpenGL state):
+	cull(world_to_clip, &visible_drawables);
+	draw_list.clear();
+	uint32_t index = 0;
 	for (auto const &drawable : drawables) {
+		if (visible_drawables[index++]) draw_list.emplace_back(&drawable);
+	}
+
+	draw(draw_list, world_to_clip, world_to_light);
+}
+
+void Scene::draw(std::vector< Drawable const * > const &list, glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	drawn = 0;
+
+	//Iterate through the drawables, sending each one to OpenGL:
+	for (Drawable const *drawable_ptr : list) {
+		assert(drawable_ptr);
+		Drawable const &drawable = *drawable_ptr;
+
 		//Reference to drawable's pipeline for convenience:
 		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
 
@@ -147,6 +324,7 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 
 		//draw the object:
 		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		drawn += 1;
 
 		//un-bind textures:
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
@@ -231,7 +409,7 @@ void Scene::load(std::string const &filename,
 			if (h.parent >= hierarchy_transforms.size()) {
 				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
 			}
-			t->parent = hierarchy_transforms[h.parent];
+			t->set_parent(hierarchy_transforms[h.parent]);
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
@@ -243,6 +421,7 @@ void Scene::load(std::string const &filename,
 		t->position = h.position;
 		t->rotation = h.rotation;
 		t->scale = h.scale;
+		t->mark_dirty();
 
 		hierarchy_transforms.emplace_back(t);
 	}
@@ -345,16 +524,16 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 		transforms.back().position = t.position;
 		transforms.back().rotation = t.rotation;
 		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
+		//(parent set later, once all transforms exist)
 
 		//store mapping between transforms old and new:
 		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
 		assert(ret.second);
 	}
 
-	//update transform parents:
-	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+	//set transform parents:
+	for (auto const &t : other.transforms) {
+		transform_to_transform.at(&t)->set_parent(transform_to_transform.at(t.parent));
 	}
 
 	//copy other's drawables, updating transform pointers:
@@ -15,6 +15,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <limits>
 #include <list>
 #include <memory>
 #include <functional>
@@ -33,13 +34,25 @@ struct Scene {
 		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
 
 		//The transform above may be relative to some parent transform:
+		// (change with set_parent(), which also keeps the parent's 'children' list up to date)
 		Transform *parent = nullptr;
+		std::vector< Transform * > children;
+
+		//World matrices are cached, so after changing position, rotation, or scale,
+		// either use these functions or call mark_dirty() afterward:
+		void set_position(glm::vec3 const &new_position);
+		void set_rotation(glm::quat const &new_rotation);
+		void set_scale(glm::vec3 const &new_scale);
+		void set_parent(Transform *new_parent);
+		//flag the cached matrices of this transform and all of its descendants for recomputation:
+		void mark_dirty();
 
 		//It is often convenient to construct matrices representing this transformation:
 		// ..relative to its parent:
 		glm::mat4x3 make_local_to_parent() const;
 		glm::mat4x3 make_parent_to_local() const;
-		// ..relative to the world:
+		// ..relative to the world (computed only when dirty, using the parent's cached matrix):
+		// n.b. this updates the cache, so don't call it on the same hierarchy from several threads at once
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
 
@@ -47,6 +60,18 @@ struct Scene {
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
 		Transform() = default;
+		//(destroying a transform detaches it from its parent and children)
+		~Transform();
+
+		//cached matrices, and which of them are out of date:
+		// (if a transform's matrix is dirty, so are all of its descendants')
+		enum : uint8_t {
+			LocalToWorldDirty = 1,
+			WorldToLocalDirty = 2,
+		};
+		mutable uint8_t dirty = LocalToWorldDirty | WorldToLocalDirty;
+		mutable glm::mat4x3 local_to_world = glm::mat4x3(1.0f);
+		mutable glm::mat4x3 world_to_local = glm::mat4x3(1.0f);
 	};
 
 	struct Drawable {
@@ -79,6 +104,16 @@ struct Scene {
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
 		} pipeline;
+
+		//bounding box of the drawn vertices, in object space (e.g., copied from Mesh::min/max):
+		// Scene::draw skips drawables whose box is entirely outside the view;
+		// the default (empty) box means "no bounds known", and such drawables are never skipped.
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		bool has_bounds() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+
+		//world-space box around the object-space box (center and half-size), via the transform's cached world matrix:
+		void make_world_bounds(glm::vec3 *center, glm::vec3 *extent) const;
 	};
 
 	struct Camera {
@@ -128,6 +163,19 @@ struct Scene {
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//..or draw just some of the drawables (e.g., those a SceneBVH found in view), in the order given:
+	void draw(std::vector< Drawable const * > const &list, glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+
+	//frustum culling (done by draw() before any OpenGL calls):
+	// sets visible[i] to whether the i'th drawable's bounds overlap the view frustum of 'world_to_clip'
+	void cull(glm::mat4 const &world_to_clip, std::vector< bool > *visible) const;
+
+	//the view frustum of 'world_to_clip' as planes (a,b,c,d), with a*x + b*y + c*z + d >= 0 inside:
+	static void make_frustum_planes(glm::mat4 const &world_to_clip, glm::vec4 (&planes)[6]);
+
+	//drawables sent to OpenGL by the last draw() (after culling):
+	mutable uint32_t drawn = 0;
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
@@ -150,4 +198,11 @@ struct Scene {
 	Scene &operator=(Scene const &); //...as scene = scene
 	//... as a set() function that optionally returns the transform->transform mapping:
 	void set(Scene const &, std::unordered_map< Transform const *, Transform * > *transform_map = nullptr);
+
+	//internals:
+	//scratch space for culling, kept between draws so drawing doesn't allocate:
+	mutable std::vector< float > cull_boxes; //world-space boxes in groups of four: [ cx x4, cy x4, cz x4, ex x4, ey x4, ez x4 ]
+	mutable std::vector< uint32_t > cull_indices; //index of the drawable that made each box
+	mutable std::vector< bool > visible_drawables;
+	mutable std::vector< Drawable const * > draw_list;
 };
@@ -0,0 +1,381 @@
+#include "SceneBVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+//leaves hold this many items or fewer, unless there is no good way to split them:
+static constexpr uint32_t LeafSize = 4;
+//...but never more than this many:
+static constexpr uint32_t MaxLeafSize = 16;
+//splits are chosen by sorting item centers into this many bins along the longest axis:
+static constexpr uint32_t Bins = 12;
+
+//surface area of a box (proportional to the chance a random ray hits it):
+static float area(glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+//world-space box of a drawable:
+static void drawable_box(Scene::Drawable const &drawable, glm::vec3 *min, glm::vec3 *max) {
+	glm::vec3 center, extent;
+	drawable.make_world_bounds(&center, &extent);
+	*min = center - extent;
+	*max = center + extent;
+}
+
+//does the ray origin + t * direction (with inv_direction = 1 / direction) hit the box for some t in [0, t_max]?
+// if so, sets *t_enter to the first such t
+static bool ray_box(glm::vec3 const &min, glm::vec3 const &max, glm::vec3 const &origin, glm::vec3 const &inv_direction, float t_max, float *t_enter) {
+	glm::vec3 t0 = (min - origin) * inv_direction;
+	glm::vec3 t1 = (max - origin) * inv_direction;
+	glm::vec3 t_near = glm::min(t0, t1);
+	glm::vec3 t_far = glm::max(t0, t1);
+	float enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+	float exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, t_max));
+	if (!(enter <= exit)) return false;
+	*t_enter = enter;
+	return true;
+}
+
+void SceneBVH::build(Scene const &scene) {
+	items.clear();
+	unbounded.clear();
+
+	uint32_t order = 0;
+	for (auto const &drawable : scene.drawables) {
+		Item item;
+		item.drawable = &drawable;
+		item.order = order++;
+		if (drawable.has_bounds()) {
+			drawable_box(drawable, &item.min, &item.max);
+			items.emplace_back(item);
+		} else {
+			unbounded.emplace_back(item);
+		}
+	}
+
+	rebuild();
+}
+
+void SceneBVH::rebuild() {
+	nodes.clear();
+	cost = 0.0f;
+	if (!items.empty()) {
+		//(a binary tree with leaves of at least one item has fewer than 2 * items.size() nodes)
+		nodes.reserve(2 * items.size());
+		nodes.emplace_back();
+		build_node(0, 0, uint32_t(items.size()));
+	}
+	built_cost = cost;
+
+	item_index.clear();
+	for (uint32_t i = 0; i < items.size(); ++i) {
+		item_index.emplace(items[i].drawable, i);
+	}
+}
+
+void SceneBVH::build_node(uint32_t n, uint32_t begin, uint32_t end) {
+	assert(begin < end);
+
+	//bounds of the items, and of their centers:
+	glm::vec3 center_min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 center_max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (uint32_t i = begin; i < end; ++i) {
+		glm::vec3 center = 0.5f * (items[i].min + items[i].max);
+		center_min = glm::min(center_min, center);
+		center_max = glm::max(center_max, center);
+	}
+
+	auto make_leaf = [&]() {
+		nodes[n].first = begin;
+		nodes[n].count = end - begin;
+		for (uint32_t i = begin; i < end; ++i) {
+			items[i].leaf = n;
+		}
+		fit_node(n); //(also adds the node's area to 'cost')
+	};
+
+	uint32_t count = end - begin;
+	if (count <= LeafSize) {
+		make_leaf();
+		return;
+	}
+
+	//split along the longest axis of the centers:
+	glm::vec3 spread = center_max - center_min;
+	uint32_t axis = (spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2));
+
+	uint32_t mid = begin;
+	if (spread[axis] > 0.0f) {
+		//bin the items by center:
+		struct Bin {
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+			uint32_t count = 0;
+		} bins[Bins];
+		float scale = float(Bins) / spread[axis];
+		auto bin_of = [&](Item const &item) {
+			float center = 0.5f * (item.min[axis] + item.max[axis]);
+			return std::min(Bins - 1, uint32_t((center - center_min[axis]) * scale));
+		};
+		for (uint32_t i = begin; i < end; ++i) {
+			Bin &bin = bins[bin_of(items[i])];
+			bin.min = glm::min(bin.min, items[i].min);
+			bin.max = glm::max(bin.max, items[i].max);
+			bin.count += 1;
+		}
+
+		//surface area heuristic: the cost of a split is the sum over both sides of (area * items):
+		float right_cost[Bins];
+		{
+			Bin right;
+			for (uint32_t b = Bins - 1; b > 0; --b) {
+				right.min = glm::min(right.min, bins[b].min);
+				right.max = glm::max(right.max, bins[b].max);
+				right.count += bins[b].count;
+				right_cost[b] = (right.count ? area(right.min, right.max) * float(right.count) : 0.0f);
+			}
+		}
+		float best_cost = std::numeric_limits< float >::infinity();
+		uint32_t best_split = 0; //(split goes between bins best_split - 1 and best_split)
+		Bin left;
+		for (uint32_t b = 1; b < Bins; ++b) {
+			left.min = glm::min(left.min, bins[b - 1].min);
+			left.max = glm::max(left.max, bins[b - 1].max);
+			left.count += bins[b - 1].count;
+			if (left.count == 0 || left.count == count) continue;
+			float split_cost = area(left.min, left.max) * float(left.count) + right_cost[b];
+			if (split_cost < best_cost) {
+				best_cost = split_cost;
+				best_split = b;
+			}
+		}
+
+		//is splitting better than just checking every item?
+		glm::vec3 all_min = glm::min(left.min, bins[Bins - 1].min);
+		glm::vec3 all_max = glm::max(left.max, bins[Bins - 1].max);
+		if (best_split != 0 && (best_cost < area(all_min, all_max) * float(count) || count > MaxLeafSize)) {
+			mid = uint32_t(std::partition(items.begin() + begin, items.begin() + end, [&](Item const &item) {
+				return bin_of(item) < best_split;
+			}) - items.begin());
+		} else if (count <= MaxLeafSize) {
+			make_leaf();
+			return;
+		}
+	}
+	if (mid == begin || mid == end) {
+		//no useful split (e.g., all centers in the same place), but too many items for one leaf:
+		mid = begin + count / 2;
+	}
+
+	uint32_t child = uint32_t(nodes.size());
+	nodes.emplace_back();
+	nodes.emplace_back();
+	nodes[n].first = child;
+	nodes[n].count = 0;
+	nodes[child].parent = n;
+	nodes[child + 1].parent = n;
+	build_node(child, begin, mid);
+	build_node(child + 1, mid, end);
+
+	fit_node(n);
+}
+
+bool SceneBVH::fit_node(uint32_t n) {
+	Node &node = nodes[n];
+	glm::vec3 min, max;
+	if (node.count > 0) {
+		min = items[node.first].min;
+		max = items[node.first].max;
+		for (uint32_t i = node.first + 1; i < node.first + node.count; ++i) {
+			min = glm::min(min, items[i].min);
+			max = glm::max(max, items[i].max);
+		}
+	} else {
+		min = glm::min(nodes[node.first].min, nodes[node.first + 1].min);
+		max = glm::max(nodes[node.first].max, nodes[node.first + 1].max);
+	}
+	if (min == node.min && max == node.max) return false;
+	cost += area(min, max) - area(node.min, node.max);
+	node.min = min;
+	node.max = max;
+	return true;
+}
+
+void SceneBVH::refit(Scene::Drawable const &drawable) {
+	auto f = item_index.find(&drawable);
+	if (f == item_index.end()) return; //(no bounds, so not in the tree)
+	Item &item = items[f->second];
+	drawable_box(drawable, &item.min, &item.max);
+
+	//grow (or shrink) nodes up the tree until one doesn't change:
+	for (uint32_t n = item.leaf; n != -1U && fit_node(n); n = nodes[n].parent) { }
+}
+
+void SceneBVH::refit() {
+	for (auto &item : items) {
+		drawable_box(*item.drawable, &item.min, &item.max);
+	}
+	//children always come after their parents, so going backward fits children first:
+	for (uint32_t n = uint32_t(nodes.size()) - 1; n < nodes.size(); --n) {
+		fit_node(n);
+	}
+	//(add up the cost from scratch, so rounding errors from incremental refits don't pile up)
+	cost = 0.0f;
+	for (auto const &node : nodes) {
+		cost += area(node.min, node.max);
+	}
+}
+
+bool SceneBVH::rebuild_if_degraded(float ratio) {
+	if (!(cost > ratio * built_cost)) return false;
+	rebuild();
+	return true;
+}
+
+void SceneBVH::frustum(glm::mat4 const &world_to_clip, std::vector< Scene::Drawable const * > *found_) const {
+	assert(found_);
+	auto &found = *found_;
+	found.clear();
+	hits.clear();
+
+	glm::vec4 planes[6];
+	Scene::make_frustum_planes(world_to_clip, planes);
+
+	//which planes does a box straddle? (-1U if it is entirely outside one)
+	// (planes not in 'mask' already contain the box's ancestor, so needn't be checked)
+	auto classify = [&planes](glm::vec3 const &min, glm::vec3 const &max, uint32_t mask) {
+		glm::vec3 center = 0.5f * (max + min);
+		glm::vec3 extent = 0.5f * (max - min);
+		for (uint32_t p = 0; p < 6; ++p) {
+			if (!(mask & (1U << p))) continue;
+			float dist = glm::dot(glm::vec3(planes[p]), center) + planes[p].w;
+			float radius = glm::dot(glm::abs(glm::vec3(planes[p])), extent);
+			if (dist + radius < 0.0f) return -1U;
+			if (dist - radius >= 0.0f) mask &= ~(1U << p);
+		}
+		return mask;
+	};
+
+	if (!nodes.empty()) {
+		//stack holds (node, mask) pairs:
+		stack.clear();
+		stack.emplace_back(0);
+		stack.emplace_back(0x3f);
+		while (!stack.empty()) {
+			uint32_t mask = stack.back(); stack.pop_back();
+			uint32_t n = stack.back(); stack.pop_back();
+			Node const &node = nodes[n];
+			mask = classify(node.min, node.max, mask);
+			if (mask == -1U) continue;
+			if (node.count > 0) {
+				for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+					//(once a node is entirely inside, its items are too)
+					if (mask == 0 || classify(items[i].min, items[i].max, mask) != -1U) {
+						hits.emplace_back(&items[i]);
+					}
+				}
+			} else {
+				stack.emplace_back(node.first);
+				stack.emplace_back(mask);
+				stack.emplace_back(node.first + 1);
+				stack.emplace_back(mask);
+			}
+		}
+	}
+
+	for (auto const &item : unbounded) {
+		hits.emplace_back(&item);
+	}
+
+	//report in scene order:
+	std::sort(hits.begin(), hits.end(), [](Item const *a, Item const *b) {
+		return a->order < b->order;
+	});
+	found.reserve(hits.size());
+	for (Item const *item : hits) {
+		found.emplace_back(item->drawable);
+	}
+}
+
+Scene::Drawable const *SceneBVH::pick(glm::vec3 const &origin, glm::vec3 const &direction, float *t_hit) const {
+	if (nodes.empty()) return nullptr;
+
+	glm::vec3 inv_direction = 1.0f / direction;
+	float best_t = std::numeric_limits< float >::infinity();
+	Scene::Drawable const *best = nullptr;
+
+	stack.clear();
+	stack.emplace_back(0);
+	while (!stack.empty()) {
+		uint32_t n = stack.back(); stack.pop_back();
+		Node const &node = nodes[n];
+		float t;
+		//(re-check, since a closer hit may have been found since this node was pushed)
+		if (!ray_box(node.min, node.max, origin, inv_direction, best_t, &t)) continue;
+
+		if (node.count > 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				Item const &item = items[i];
+				if (!ray_box(item.min, item.max, origin, inv_direction, best_t, &t)) continue;
+				//world-space boxes are loose, so check against the drawable's own box in object space:
+				// (t means the same thing in both spaces, since the transform is affine)
+				Scene::Drawable const &drawable = *item.drawable;
+				glm::mat4x3 world_to_local = drawable.transform->make_world_to_local();
+				glm::vec3 local_origin = world_to_local * glm::vec4(origin, 1.0f);
+				glm::vec3 local_direction = world_to_local * glm::vec4(direction, 0.0f);
+				if (!ray_box(drawable.min, drawable.max, local_origin, 1.0f / local_direction, best_t, &t)) continue;
+				best_t = t;
+				best = &drawable;
+			}
+		} else {
+			//visit the nearer child first (so it is pushed last):
+			float t0 = std::numeric_limits< float >::infinity();
+			float t1 = std::numeric_limits< float >::infinity();
+			bool hit0 = ray_box(nodes[node.first].min, nodes[node.first].max, origin, inv_direction, best_t, &t0);
+			bool hit1 = ray_box(nodes[node.first + 1].min, nodes[node.first + 1].max, origin, inv_direction, best_t, &t1);
+			if (t0 <= t1) {
+				if (hit1) stack.emplace_back(node.first + 1);
+				if (hit0) stack.emplace_back(node.first);
+			} else {
+				if (hit0) stack.emplace_back(node.first);
+				if (hit1) stack.emplace_back(node.first + 1);
+			}
+		}
+	}
+
+	if (best && t_hit) *t_hit = best_t;
+	return best;
+}
+
+void SceneBVH::overlap(glm::vec3 const &min, glm::vec3 const &max, std::vector< Scene::Drawable const * > *found_) const {
+	assert(found_);
+	auto &found = *found_;
+	found.clear();
+	if (nodes.empty()) return;
+
+	auto overlaps = [&min, &max](glm::vec3 const &box_min, glm::vec3 const &box_max) {
+		return box_min.x <= max.x && min.x <= box_max.x
+		    && box_min.y <= max.y && min.y <= box_max.y
+		    && box_min.z <= max.z && min.z <= box_max.z;
+	};
+
+	stack.clear();
+	stack.emplace_back(0);
+	while (!stack.empty()) {
+		uint32_t n = stack.back(); stack.pop_back();
+		Node const &node = nodes[n];
+		if (!overlaps(node.min, node.max)) continue;
+		if (node.count > 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				if (overlaps(items[i].min, items[i].max)) found.emplace_back(items[i].drawable);
+			}
+		} else {
+			stack.emplace_back(node.first);
+			stack.emplace_back(node.first + 1);
+		}
+	}
+}
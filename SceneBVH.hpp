@@ -0,0 +1,104 @@
+#pragma once
+
+/*
+ * A SceneBVH is a bounding volume hierarchy over a Scene's drawables, for
+ * finding the drawables in a view, under a ray, or near a box without
+ * looking at all of them:
+ *
+ *  - each drawable with bounds (see Scene::Drawable::min/max) is stored with
+ *    its world-space box; nodes are binary, and built top-down by choosing
+ *    splits with the surface area heuristic;
+ *  - when drawables move, refit() recomputes their boxes and grows/shrinks
+ *    the nodes above them, which is fast but leaves the tree's splits as they
+ *    were -- so, once refitting has made the tree a lot worse than it was
+ *    when built, rebuild_if_degraded() builds it again from scratch;
+ *  - drawables without bounds are kept off to the side, and are always
+ *    included in frustum queries (just as Scene::cull never culls them).
+ *
+ * The BVH refers to drawables by pointer, so build() again after adding or
+ * removing drawables.
+ *
+ * Usage:
+ *   SceneBVH bvh;
+ *   bvh.build(scene);
+ *   //each frame:
+ *   for (auto const &drawable : moved_drawables) bvh.refit(*drawable);
+ *   bvh.rebuild_if_degraded();
+ *   bvh.frustum(world_to_clip, &in_view);
+ *   scene.draw(in_view, world_to_clip);
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+struct SceneBVH {
+	//build over all of 'scene's drawables (using their transforms' current world matrices):
+	void build(Scene const &scene);
+
+	//recompute a drawable's world-space box (after its transform, or its parents', changed):
+	void refit(Scene::Drawable const &drawable);
+	//...or every drawable's box (one pass over the tree):
+	void refit();
+
+	//build again (with the same drawables) if refits have made the tree much worse than when it was built:
+	// returns true if it rebuilt
+	bool rebuild_if_degraded(float ratio = 2.0f);
+
+	//drawables whose bounds might be in view of 'world_to_clip' (plus all drawables without bounds):
+	// (in the same order as in scene.drawables, so drawing order -- and blending -- is unchanged)
+	void frustum(glm::mat4 const &world_to_clip, std::vector< Scene::Drawable const * > *found) const;
+
+	//nearest drawable whose (object-space) bounding box is hit by the ray origin + t * direction, t >= 0:
+	// returns nullptr if nothing was hit; otherwise, sets *t_hit (if given)
+	Scene::Drawable const *pick(glm::vec3 const &origin, glm::vec3 const &direction, float *t_hit = nullptr) const;
+
+	//drawables whose world-space boxes overlap the box [min, max]:
+	void overlap(glm::vec3 const &min, glm::vec3 const &max, std::vector< Scene::Drawable const * > *found) const;
+
+	//number of drawables with bounds in the tree:
+	uint32_t size() const { return uint32_t(items.size()); }
+
+	//internals:
+	struct Node {
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+		uint32_t parent = -1U; //(-1U for the root)
+		uint32_t first = 0; //leaf: first item; interior: first child (the second is first + 1)
+		uint32_t count = 0; //leaf: number of items (always > 0); interior: 0
+	};
+	std::vector< Node > nodes; //nodes[0] is the root (if there are any items)
+
+	//drawables with bounds, in leaf order -- each leaf's items are contiguous:
+	struct Item {
+		Scene::Drawable const *drawable = nullptr;
+		uint32_t order = 0; //index of the drawable in scene.drawables (for sorting query results)
+		uint32_t leaf = 0; //node holding this item
+		glm::vec3 min = glm::vec3(0.0f), max = glm::vec3(0.0f); //world-space box
+	};
+	std::vector< Item > items;
+	std::unordered_map< Scene::Drawable const *, uint32_t > item_index; //drawable -> index in items
+
+	std::vector< Item > unbounded; //drawables without bounds (only 'drawable' and 'order' are used)
+
+	//summed surface area of all nodes ("how expensive is a query"), now and right after the last build:
+	float cost = 0.0f;
+	float built_cost = 0.0f;
+
+	//scratch space, kept between queries so they don't allocate:
+	// (n.b. so only one query at a time, please)
+	mutable std::vector< uint32_t > stack;
+	mutable std::vector< Item const * > hits;
+
+	//helper: (re)build the nodes over the current items:
+	void rebuild();
+	//helper: make node 'n' hold items [begin, end), splitting it if worthwhile:
+	void build_node(uint32_t n, uint32_t begin, uint32_t end);
+	//helper: set a node's box from its children (or items), updating 'cost'; returns true if the box changed:
+	bool fit_node(uint32_t n);
+};
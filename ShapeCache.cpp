@@ -0,0 +1,104 @@
+#include "ShapeCache.hpp"
+
+#include <hb-ft.h>
+
+#include <cassert>
+#include <functional>
+#include <stdexcept>
+
+ShapeCache::ShapeCache(uint32_t max_runs_) : max_runs(max_runs_) {
+	assert(max_runs > 0);
+	buffer = hb_buffer_create();
+}
+
+ShapeCache::~ShapeCache() {
+	clear();
+	for (auto &f : fonts) {
+		hb_font_destroy(f.second);
+	}
+	fonts.clear();
+	hb_buffer_destroy(buffer);
+	buffer = nullptr;
+}
+
+size_t ShapeCache::KeyHash::operator()(Key const &key) const {
+	size_t h = std::hash< std::string >{}(key.text);
+	h ^= std::hash< FT_Face >{}(key.face) + 0x9e3779b9 + (h << 6) + (h >> 2);
+	h ^= std::hash< uint32_t >{}(key.pixel_size) + 0x9e3779b9 + (h << 6) + (h >> 2);
+	return h;
+}
+
+ShapeCache::Run const &ShapeCache::shape(std::string const &text, FT_Face face, uint32_t pixel_size) {
+	assert(face);
+	Key key{text, face, pixel_size};
+
+	{ //already shaped?
+		auto f = run_lookup.find(key);
+		if (f != run_lookup.end()) {
+			hits += 1;
+			//move to front of the list (most-recently-used):
+			runs.splice(runs.begin(), runs, f->second);
+			return f->second->second;
+		}
+	}
+	misses += 1;
+
+	//get (or create) the HarfBuzz font for this face:
+	hb_font_t *font;
+	{
+		auto f = fonts.find(face);
+		if (f == fonts.end()) {
+			font = hb_ft_font_create_referenced(face);
+			fonts.emplace(face, font);
+		} else {
+			font = f->second;
+		}
+	}
+
+	//make sure the face (and the HarfBuzz font wrapping it) is at the requested size:
+	if (face->size == nullptr || face->size->metrics.y_ppem != pixel_size) {
+		if (FT_Set_Pixel_Sizes(face, 0, pixel_size)) {
+			throw std::runtime_error("ShapeCache: failed to set pixel size " + std::to_string(pixel_size) + ".");
+		}
+	}
+	hb_ft_font_changed(font);
+
+	// SOURCE for setting up harfbuzz: https://github.com/harfbuzz/harfbuzz-tutorial/blob/master/hello-harfbuzz-freetype.c
+	hb_buffer_reset(buffer);
+	hb_buffer_add_utf8(buffer, text.c_str(), int(text.size()), 0, int(text.size()));
+	hb_buffer_guess_segment_properties(buffer);
+
+	hb_shape(font, buffer, nullptr, 0);
+
+	unsigned int len = hb_buffer_get_length(buffer);
+	hb_glyph_info_t *info = hb_buffer_get_glyph_infos(buffer, nullptr);
+	hb_glyph_position_t *pos = hb_buffer_get_glyph_positions(buffer, nullptr);
+
+	runs.emplace_front();
+	runs.front().first = key;
+	Run &run = runs.front().second;
+	run.glyphs.reserve(len);
+	for (unsigned int i = 0; i < len; ++i) {
+		run.glyphs.emplace_back();
+		Glyph &glyph = run.glyphs.back();
+		glyph.index = info[i].codepoint; //(after shaping, 'codepoint' holds the glyph index)
+		glyph.x_advance = pos[i].x_advance;
+		glyph.y_advance = pos[i].y_advance;
+		glyph.x_offset = pos[i].x_offset;
+		glyph.y_offset = pos[i].y_offset;
+	}
+	run_lookup.emplace(std::move(key), runs.begin());
+
+	//drop least-recently-used runs over budget:
+	while (runs.size() > max_runs) {
+		run_lookup.erase(runs.back().first);
+		runs.pop_back();
+	}
+
+	return run;
+}
+
+void ShapeCache::clear() {
+	run_lookup.clear();
+	runs.clear();
+}
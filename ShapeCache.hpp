@@ -0,0 +1,79 @@
+#pragma once
+
+/*
+ * A ShapeCache remembers the results of running HarfBuzz on strings, so
+ * text that is drawn every frame only needs to be shaped once.
+ *
+ * Shaped runs are keyed by (text, face, pixel size); the least-recently-used
+ * runs are dropped once more than 'max_runs' are cached.
+ *
+ * Usage:
+ *   ShapeCache shape_cache;
+ *   ShapeCache::Run const &run = shape_cache.shape("Hello", face, 48);
+ *   for (auto const &glyph : run.glyphs) { ... }
+ *
+ */
+
+#include <hb.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+struct ShapeCache {
+	ShapeCache(uint32_t max_runs = 256);
+	~ShapeCache();
+
+	//holds HarfBuzz objects, so copying is not advised:
+	ShapeCache(ShapeCache const &) = delete;
+
+	struct Glyph {
+		uint32_t index = 0; //glyph index in the face (for use with GlyphAtlas::lookup)
+		//positions are in 1/64ths of a pixel:
+		int32_t x_advance = 0, y_advance = 0;
+		int32_t x_offset = 0, y_offset = 0;
+	};
+
+	struct Run {
+		std::vector< Glyph > glyphs;
+	};
+
+	//get the shaped glyphs for 'text' set in 'face' at 'pixel_size' pixels:
+	//NOTE: the returned reference is only valid until the next call to shape()
+	Run const &shape(std::string const &text, FT_Face face, uint32_t pixel_size);
+
+	//drop all cached runs:
+	void clear();
+
+	//-- internals --
+
+	uint32_t max_runs;
+
+	struct Key {
+		std::string text;
+		FT_Face face;
+		uint32_t pixel_size;
+		bool operator==(Key const &other) const {
+			return face == other.face && pixel_size == other.pixel_size && text == other.text;
+		}
+	};
+	struct KeyHash {
+		size_t operator()(Key const &key) const;
+	};
+
+	//runs, most-recently-used first:
+	std::list< std::pair< Key, Run > > runs;
+	std::unordered_map< Key, std::list< std::pair< Key, Run > >::iterator, KeyHash > run_lookup;
+
+	//HarfBuzz objects are created once and reused:
+	std::unordered_map< FT_Face, hb_font_t * > fonts;
+	hb_buffer_t *buffer = nullptr;
+
+	//statistics (handy for checking that static text isn't being re-shaped):
+	uint32_t hits = 0;
+	uint32_t misses = 0;
+};
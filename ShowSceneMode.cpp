@@ -14,12 +14,33 @@ ShowSceneMode::ShowSceneMode(Scene const &scene_) : scene(scene_) {
 		scene_camera->near = 0.01f;
 		//scene_camera->transform and scene_camera->aspect will be set in draw()
 	}
+
+	bvh.build(scene);
 }
 
 ShowSceneMode::~ShowSceneMode() {
 }
 
 bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
+	//----- picking -----
+	if (evt.type == SDL_MOUSEBUTTONDOWN && evt.button.button == SDL_BUTTON_RIGHT) {
+		//ray from the camera through the clicked pixel (camera set up as of the last draw()):
+		glm::vec2 ndc = glm::vec2(
+			(evt.button.x + 0.5f) / float(window_size.x) * 2.0f - 1.0f,
+			(evt.button.y + 0.5f) / float(window_size.y) *-2.0f + 1.0f
+		);
+		float tan_half_fovy = std::tan(0.5f * scene_camera->fovy);
+		glm::mat4x3 camera_to_world = scene_camera->transform->make_local_to_world();
+		glm::vec3 origin = camera_to_world[3];
+		glm::vec3 direction = camera_to_world * glm::vec4(ndc.x * tan_half_fovy * scene_camera->aspect, ndc.y * tan_half_fovy, -1.0f, 0.0f);
+
+		picked = bvh.pick(origin, direction);
+		if (picked) {
+			std::cout << "Picked '" << picked->transform->name << "'." << std::endl;
+		}
+		return true;
+	}
+
 	//----- trackball-style camera controls -----
 	if (evt.type == SDL_MOUSEBUTTONDOWN) {
 		if (evt.button.button == SDL_BUTTON_LEFT) {
@@ -75,12 +96,12 @@ bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_
 void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	//--- use camera structure to set up scene camera ---
 
-	scene_camera->transform->rotation =
+	scene_camera->transform->set_rotation(
 		glm::angleAxis(camera.azimuth, glm::vec3(0.0f, 0.0f, 1.0f))
 		* glm::angleAxis(0.5f * 3.1415926f + -camera.elevation, glm::vec3(1.0f, 0.0f, 0.0f))
-	;
-	scene_camera->transform->position = camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f));
-	scene_camera->transform->scale = glm::vec3(1.0f);
+	);
+	scene_camera->transform->set_position(camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f)));
+	scene_camera->transform->set_scale(glm::vec3(1.0f));
 	scene_camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
 
@@ -91,10 +112,32 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
 
-	scene.draw(*scene_camera);
+	glm::mat4 world_to_clip = scene_camera->make_projection() * glm::mat4(scene_camera->transform->make_world_to_local());
+	bvh.frustum(world_to_clip, &in_view);
+	scene.draw(in_view, world_to_clip);
 
 	{ //decorate with some lines:
-		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene_camera->transform->make_world_to_local()));
+		DrawLines draw_lines(world_to_clip);
+
+		if (picked) {
+			//outline picked drawable's bounding box:
+			glm::mat4x3 local_to_world = picked->transform->make_local_to_world();
+			glm::vec3 corners[8];
+			for (uint32_t c = 0; c < 8; ++c) {
+				corners[c] = local_to_world * glm::vec4(
+					(c & 1 ? picked->max.x : picked->min.x),
+					(c & 2 ? picked->max.y : picked->min.y),
+					(c & 4 ? picked->max.z : picked->min.z),
+					1.0f
+				);
+			}
+			for (uint32_t c = 0; c < 8; ++c) {
+				for (uint32_t bit = 1; bit < 8; bit <<= 1) {
+					if (!(c & bit)) draw_lines.draw(corners[c], corners[c | bit], glm::u8vec4(0xff, 0x00, 0xff, 0xff));
+				}
+			}
+		}
+
 		for (auto &transform : scene.transforms) {
 			glm::mat4 local_to_world = transform.make_local_to_world();
 			auto xf = [&local_to_world](glm::vec3 const &vec) {
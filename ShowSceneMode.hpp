@@ -5,10 +5,13 @@
  * ShowSceneMode exists to show the contents of a Scene; this can be useful
  * if, e.g., you aren't sure if things are being exported properly.
  *
+ * Right-click a drawable to outline it and print its transform's name.
+ *
  */
 
 #include "Mode.hpp"
 #include "Scene.hpp"
+#include "SceneBVH.hpp"
 #include "Mesh.hpp"
 
 struct ShowSceneMode : Mode {
@@ -30,6 +33,14 @@ struct ShowSceneMode : Mode {
 	//Scene being viewed:
 	Scene const &scene;
 
+	//bounding volume hierarchy over the scene's drawables, for culling and picking:
+	// (the scene doesn't move, so this is built once)
+	SceneBVH bvh;
+	std::vector< Scene::Drawable const * > in_view; //(scratch space for draw())
+
+	//drawable most recently right-clicked (if any):
+	Scene::Drawable const *picked = nullptr;
+
 	//mode uses a secondary Scene to hold a camera:
 	Scene camera_scene;
 	Scene::Camera *scene_camera = nullptr;
@@ -1,27 +1,201 @@
 #include "Sound.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "Convolver.hpp"
 
 #include <SDL.h>
 
-#include <list>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <exception>
 #include <iostream>
 #include <algorithm>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOUND_MIX_SSE2
+#include <emmintrin.h>
+#endif
+
+//stereo output frame:
+struct LR {
+	float l;
+	float r;
+};
+static_assert(sizeof(LR) == 8, "Sample is packed");
+
 //local (to this file) data used by the audio system:
 namespace {
 
 	//handy constants:
 	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	constexpr uint32_t const MIX_SAMPLES = Sound::BlockSamples; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	constexpr float const INAUDIBLE_GAIN = 1e-4f; //voices with gains below this (-80dB) are never mixed
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//is Sound::render() mixing? (only touched with the audio device locked)
+	bool offline = false;
+
+	//Voices book-keep samples that are currently playing:
+	// (only touched by the audio thread, or with the audio device locked)
+	struct Voice {
+		std::vector< float > const *data = nullptr; //sample data being played
+		uint32_t i = 0; //next data value to read
+		double frac = 0.0; //fractional part of the playback position (between data[i] and data[i+1])
+		float rate = 1.0f; //data values per output sample (at pitch 1)
+		Sound::Ramp< float > pitch = Sound::Ramp< float >(1.0f);
+		Sound::Interpolation interpolation = Sound::Interpolation::Linear;
+		float start_step, end_step; //data values per output sample at the start and end of this block
+		Sound::Stream *stream = nullptr; //stream being played (instead of data)
+		uint32_t play = 0; //which play of the stream this voice is
+		bool synced = false; //has the voice skipped stream samples left over from earlier plays?
+		bool loop = false; //should playback loop after data runs out?
+		bool stopping = false; //is playing stopping?
+
+		//voice management: when more voices are audible than max_real_voices, only the
+		// highest-priority (then loudest) voices are mixed; the rest are 'virtual' -- they keep their place in the data, but aren't heard:
+		float priority = 0.0f;
+		enum State : uint8_t {
+			New, //hasn't been mixed yet
+			Real, //was mixed last block
+			Virtual, //wasn't mixed last block
+		} state = New;
+		bool mix = false; //should the voice be mixed this block?
+		LR start_gain, end_gain; //gains at the start and end of this block
+		float loudness = 0.0f; //largest gain this block, including bus and global volume
+
+		Sound::Bus bus = Sound::Bus::SFX; //bus the voice is mixed into
+		Sound::Ramp< float > reverb_send = Sound::Ramp< float >(0.0f); //how much of the voice is also mixed into the reverb
+		float start_send, end_send; //reverb send at the start and end of this block
+
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+
+		//2D playback panning control: ('NaN' if sound played in 3D mode)
+		Sound::Ramp< float > pan = Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN());
+
+		//3D playback panning control: ('NaN' if sound played in 2D mode)
+		Sound::Ramp< glm::vec3 > position = Sound::Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
+		Sound::Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
+	};
+
+	//fixed pool of voices; PlayingSample handles refer to slots in the pool:
+	std::array< Voice, Sound::MaxVoices > voices;
+
+	//each slot's generation is incremented (by the audio thread) when its voice finishes,
+	// which invalidates handles to it:
+	std::array< std::atomic< uint32_t >, Sound::MaxVoices > generations{};
+
+	//slots of playing voices, packed at the front (only touched by the audio thread):
+	std::array< uint32_t, Sound::MaxVoices > active;
+	uint32_t active_count = 0;
+
+	//at most this many voices are mixed each block (only touched by the audio thread):
+	uint32_t max_real_voices = Sound::DefaultMaxRealVoices;
+
+	//Effects in bus slots, along with their running state:
+	struct EffectState {
+		Sound::Effect effect;
+		//LowPass: filter coefficients and (per-channel) state
+		float b0 = 0.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+		LR z1 = LR{ 0.0f, 0.0f }, z2 = LR{ 0.0f, 0.0f };
+		//Compressor: current gain reduction (dB); Limiter: current gain
+		float envelope = 0.0f;
+		float attack_coef = 0.0f, release_coef = 0.0f; //per-sample smoothing
+	};
+
+	//Buses (only touched by the audio thread):
+	struct BusState {
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f); //(Master uses Sound::volume instead)
+		std::array< EffectState, Sound::EffectSlots > effects;
+		std::array< LR, MIX_SAMPLES > mix; //voices are mixed here (Master mixes directly into the output)
+	};
+	std::array< BusState, Sound::BusCount > buses;
+
+	//Convolution reverb (only touched by the audio thread):
+	Convolver *reverb = nullptr; //(owned by the game thread; see 'reverbs', below)
+	std::array< LR, MIX_SAMPLES > reverb_input; //voices' reverb sends are mixed here
+	std::array< LR, MIX_SAMPLES > voice_mix; //scratch: a voice that sends to the reverb is mixed here first
+	static_assert(Convolver::BlockSize == MIX_SAMPLES, "reverb works in mixer-sized blocks");
+
+	//single-producer, single-consumer lock-free ring:
+	template< typename T, uint32_t Capacity >
+	struct Ring {
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+		std::array< T, Capacity > slots;
+		std::atomic< uint32_t > head = 0; //next slot to read (written by consumer)
+		std::atomic< uint32_t > tail = 0; //next slot to write (written by producer)
+
+		bool push(T const &value) {
+			uint32_t t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) == Capacity) return false; //full
+			slots[t & (Capacity - 1)] = value;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+		bool pop(T *value) {
+			uint32_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire)) return false; //empty
+			*value = slots[h & (Capacity - 1)];
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+	};
+
+	//Changes to playback are sent from the game thread to the audio thread as commands:
+	struct Command {
+		enum Type : uint8_t {
+			Play, //start voice 'slot' playing 'data'; position in value, (volume, pan, half-volume radius) in value2
+			SetVolume, //voice volume to value.x
+			SetPan, //voice pan to value.x
+			SetPosition, //voice position to value
+			SetHalfVolumeRadius, //voice half-volume radius to value.x
+			SetPitch, //voice pitch to value.x
+			SetInterpolation, //voice interpolation to Sound::Interpolation(value.x)
+			SetBus, //voice bus to 'bus'
+			SetPriority, //voice priority to value.x
+			Stop, //stop voice
+			StopAll, //stop all voices
+			SetGlobalVolume, //Sound::volume to value.x
+			SetMaxRealVoices, //max_real_voices to value.x
+			SetBusVolume, //volume of 'bus' to value.x
+			SetBusEffect, //effect slot 'slot' of 'bus' to 'effect'
+			SetListener, //listener position to value, right to value2
+			SetReverbSend, //voice reverb send to value.x
+			SetReverb, //reverb to 'reverb' (numbered 'serial')
+		} type = Play;
+		bool loop = false; //(Play only)
+		uint32_t slot = 0, generation = 0; //voice the command applies to (ignored if its generation has changed)
+		std::vector< float > const *data = nullptr; //(Play only)
+		Sound::Stream *stream = nullptr; //(Play only) stream to play instead of data
+		uint32_t play = 0; //(Play only) which play of the stream
+		float rate = 1.0f; //(Play only) sample rate relative to the output rate
+		Sound::Bus bus = Sound::Bus::SFX; //(Play, SetBus, SetBusVolume, SetBusEffect)
+		Sound::Effect effect; //(SetBusEffect only)
+		Convolver *reverb = nullptr; //(SetReverb only; nullptr turns the reverb off)
+		uint32_t serial = 0; //(SetReverb only)
+		glm::vec3 value = glm::vec3(0.0f);
+		glm::vec3 value2 = glm::vec3(0.0f);
+		float ramp = 0.0f;
+	};
+	Ring< Command, 1024 > commands; //game thread -> audio thread
+
+	//slots of finished voices, ready to be reused:
+	Ring< uint32_t, Sound::MaxVoices > finished_slots; //audio thread -> game thread
+	std::vector< uint32_t > free_slots = [](){ //only touched by the game thread
+		std::vector< uint32_t > slots;
+		slots.reserve(Sound::MaxVoices);
+		for (uint32_t s = Sound::MaxVoices; s > 0; --s) slots.emplace_back(s - 1);
+		return slots;
+	}();
+
+	//Reverbs are built by the game thread and handed to the audio thread by pointer;
+	// each is numbered, and once the audio thread has switched to a later one the earlier ones are deleted:
+	std::vector< std::pair< uint32_t, std::unique_ptr< Convolver > > > reverbs; //only touched by the game thread
+	uint32_t reverb_serial = 0; //number of the most recent reverb (game thread only)
+	std::atomic< uint32_t > reverb_in_use = 0; //number of the reverb the audio thread is using (written by the audio thread)
 
 }
 
@@ -40,7 +214,9 @@ void mix_audio(void *, Uint8 *buffer_, int len);
 
 Sound::Sample::Sample(std::string const &filename) {
 	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
-		load_wav(filename, &data);
+		uint32_t file_rate = 0;
+		load_wav(filename, &data, &file_rate);
+		rate = float(file_rate);
 	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
 		load_opus(filename, &data);
 	} else {
@@ -48,7 +224,99 @@ Sound::Sample::Sample(std::string const &filename) {
 	}
 }
 
-Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
+Sound::Sample::Sample(std::vector< float > const &data_, float rate_) : data(data_), rate(rate_) {
+}
+
+Sound::Stream::Stream(std::string const &filename) : ring(Capacity, 0.0f), reader(std::make_unique< OpusReader >(filename)) {
+	//start decoding right away, so the first play doesn't wait:
+	thread = std::thread(&Stream::decode, this);
+}
+
+//helper: make sure no voice is playing (or about to play) a stream (defined below with the other internals):
+static void detach_stream(Sound::Stream const *stream);
+
+Sound::Stream::~Stream() {
+	//the audio thread mustn't touch the stream after this, even if a voice was still fading out:
+	detach_stream(this);
+
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		quit = true;
+	}
+	cv.notify_one();
+	thread.join();
+}
+
+void Sound::Stream::decode() {
+	std::vector< float > chunk(4096, 0.0f);
+	uint32_t play = 1; //play currently being decoded
+	bool at_end = false; //has the end of the file been decoded (and not looped)?
+	bool rewound = true; //no samples decoded since the last rewind? (guards against looping an empty file forever)
+	uint32_t position = tail.load(std::memory_order_relaxed); //(only this thread writes 'tail')
+
+	for (;;) {
+		{ //wait until there is something to do:
+			// (the audio thread doesn't signal when it makes room, so also check every few milliseconds)
+			std::unique_lock< std::mutex > lock(mutex);
+			bool ready = cv.wait_for(lock, std::chrono::milliseconds(5), [&]() -> bool {
+				if (quit || requested.load(std::memory_order_relaxed) != play) return true;
+				if (at_end) return looping.load(std::memory_order_relaxed) && !rewound;
+				return Capacity - (position - head.load(std::memory_order_acquire)) >= chunk.size();
+			});
+			if (quit) break;
+			if (!ready) continue;
+		}
+
+		try {
+			if (requested.load(std::memory_order_relaxed) != play) {
+				//start over for a new play:
+				play = requested.load(std::memory_order_relaxed);
+				reader->rewind();
+				rewound = true;
+				at_end = false;
+				started.store((uint64_t(play) << 32) | position, std::memory_order_release);
+				continue;
+			}
+			if (at_end) {
+				//the stream was looped after its end was decoded:
+				reader->rewind();
+				rewound = true;
+				at_end = false;
+			}
+
+			uint32_t count = reader->read(chunk.data(), uint32_t(chunk.size()));
+			if (count == 0) {
+				if (looping.load(std::memory_order_relaxed) && !rewound) {
+					reader->rewind();
+					rewound = true;
+				} else {
+					at_end = true;
+					ended.store(play, std::memory_order_release);
+				}
+				continue;
+			}
+			rewound = false;
+
+			//copy into the ring buffer (in two pieces if it wraps):
+			uint32_t offset = position & (Capacity - 1);
+			uint32_t first = std::min(count, Capacity - offset);
+			std::copy(chunk.begin(), chunk.begin() + first, ring.begin() + offset);
+			std::copy(chunk.begin() + first, chunk.begin() + count, ring.begin());
+			position += count;
+			tail.store(position, std::memory_order_release);
+		} catch (std::exception &e) {
+			std::cerr << "Error decoding stream: " << e.what() << std::endl;
+			//make sure the play has a start (in case rewinding for it failed), so its voice can sync and finish:
+			if (uint32_t(started.load(std::memory_order_relaxed) >> 32) != play) {
+				started.store((uint64_t(play) << 32) | position, std::memory_order_release);
+			}
+			failed.store(play, std::memory_order_release);
+			at_end = true;
+			ended.store(play, std::memory_order_release);
+			//don't retry (even when looping) until a new play is requested:
+			rewound = true;
+		}
+	}
 }
 
 
@@ -91,6 +359,17 @@ void Sound::shutdown() {
 }
 
 
+void Sound::render(float *buffer, uint32_t blocks) {
+	assert(buffer);
+	lock(); //(in case a device is open, keep the callback from mixing at the same time)
+	offline = true;
+	for (uint32_t b = 0; b < blocks; ++b) {
+		mix_audio(nullptr, reinterpret_cast< Uint8 * >(buffer + b * 2 * MIX_SAMPLES), MIX_SAMPLES * sizeof(LR));
+	}
+	offline = false;
+	unlock();
+}
+
 void Sound::lock() {
 	if (device) SDL_LockAudioDevice(device);
 }
@@ -99,110 +378,339 @@ void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+//helper: run a command on the audio thread (defined below with the other internals):
+static void execute(Command const &command);
+
+//helper: run all queued commands (on the audio thread, or with the audio device locked):
+static void execute_queued() {
+	Command command;
+	while (commands.pop(&command)) {
+		execute(command);
+	}
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+//helper: invalidate handles to the voice at active[a], hand its slot back to the game thread, and remove it from the active list:
+// (on the audio thread, or with the audio device locked)
+static void retire_voice(uint32_t a) {
+	assert(a < active_count);
+	uint32_t slot = active[a];
+	generations[slot].store(generations[slot].load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	bool pushed = finished_slots.push(slot);
+	assert(pushed && "finished_slots can hold every slot"); (void)pushed;
+	//(moving the last voice into its place)
+	active_count -= 1;
+	active[a] = active[active_count];
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+static void detach_stream(Sound::Stream const *stream) {
+	Sound::lock();
+	//run queued commands first, in case one of them starts the stream:
+	execute_queued();
+	for (uint32_t a = 0; a < active_count; /* later */) {
+		if (voices[active[a]].stream == stream) {
+			voices[active[a]].stream = nullptr;
+			retire_voice(a);
+		} else {
+			++a;
+		}
+	}
+	Sound::unlock();
 }
 
+//helper: hand a command to the audio thread:
+// returns false only for a Play command that didn't fit in the queue (the caller should give back its slot);
+// other commands change state the game is counting on (e.g., stopping a loop), so they are never dropped
+static bool send(Command const &command) {
+	if (device == 0) {
+		//no audio thread, so nothing else is touching playback state:
+		execute(command);
+		return true;
+	}
+	if (commands.push(command)) return true;
 
+	//the audio thread isn't keeping up (or isn't running):
+	static bool warned = false;
+	if (!warned) {
+		std::cerr << "WARNING: Sound command queue is full; skipping new sounds and waiting on the audio thread for other changes." << std::endl;
+		warned = true;
+	}
+	if (command.type == Command::Play) return false;
+
+	//pause the audio thread, catch up on the queue (so commands still run in order), then run this one:
+	SDL_LockAudioDevice(device);
+	execute_queued();
+	execute(command);
+	SDL_UnlockAudioDevice(device);
+	return true;
+}
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+static void send(Command::Type type, Sound::PlayingSample const &playing_sample, glm::vec3 const &value, float ramp) {
+	Command command;
+	command.type = type;
+	command.slot = playing_sample.slot;
+	command.generation = playing_sample.generation;
+	command.value = value;
+	command.ramp = ramp;
+	send(command);
 }
 
+//helper: claim a voice and start it playing:
+static Sound::PlayingSample start(std::vector< float > const *data, float rate, Sound::Stream *stream, uint32_t play, bool loop, float volume, float pan, glm::vec3 const &position, float half_volume_radius, Sound::Bus bus) {
+	Sound::PlayingSample playing_sample;
 
-void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
+	//get a free slot (collecting slots the audio thread has finished with, if needed):
+	if (free_slots.empty()) {
+		uint32_t slot;
+		while (finished_slots.pop(&slot)) {
+			free_slots.emplace_back(slot);
+		}
 	}
-	unlock();
+	if (free_slots.empty()) {
+		static bool warned = false;
+		if (!warned) {
+			std::cerr << "WARNING: All " << Sound::MaxVoices << " voices are playing; not playing sample." << std::endl;
+			warned = true;
+		}
+		return playing_sample; //(already stopped)
+	}
+	playing_sample.slot = free_slots.back();
+	free_slots.pop_back();
+	playing_sample.generation = generations[playing_sample.slot].load(std::memory_order_acquire);
+
+	if (data && data->empty()) {
+		//nothing to play; finish right away:
+		// (n.b. not done on the audio thread, but it is also the only thread that could be using the slot)
+		generations[playing_sample.slot].store(playing_sample.generation + 1, std::memory_order_release);
+		free_slots.emplace_back(playing_sample.slot);
+		return playing_sample;
+	}
+
+	Command command;
+	command.type = Command::Play;
+	command.loop = loop;
+	command.slot = playing_sample.slot;
+	command.generation = playing_sample.generation;
+	command.data = data;
+	command.rate = rate / float(AUDIO_RATE);
+	command.bus = bus;
+	command.stream = stream;
+	command.play = play;
+	command.value = position;
+	command.value2 = glm::vec3(volume, pan, half_volume_radius);
+	if (!send(command)) {
+		//the audio thread will never hear about this voice, so finish it here (as for empty data, above):
+		generations[playing_sample.slot].store(playing_sample.generation + 1, std::memory_order_release);
+		free_slots.emplace_back(playing_sample.slot);
+		return playing_sample; //(already stopped)
+	}
+
+	return playing_sample;
 }
 
-void Sound::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+Sound::PlayingSample Sound::play(Sample const &sample, float volume, float pan) {
+	return start(&sample.data, sample.rate, nullptr, 0, false, volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), Sound::Bus::SFX);
 }
 
-//------------------
+Sound::PlayingSample Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
+	return start(&sample.data, sample.rate, nullptr, 0, false, volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, Sound::Bus::SFX);
+}
 
-void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
+Sound::PlayingSample Sound::loop(Sample const &sample, float volume, float pan) {
+	return start(&sample.data, sample.rate, nullptr, 0, true, volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), Sound::Bus::SFX);
+}
+
+
+
+Sound::PlayingSample Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
+	return start(&sample.data, sample.rate, nullptr, 0, true, volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, Sound::Bus::SFX);
+}
+
+//helper: request a new play of a stream from the decoding thread, then start a voice for it:
+static Sound::PlayingSample start(Sound::Stream &stream, bool loop, float volume, float pan) {
+	stream.plays += 1;
+	stream.looping.store(loop, std::memory_order_relaxed);
+	{
+		std::lock_guard< std::mutex > lock(stream.mutex);
+		stream.requested.store(stream.plays, std::memory_order_relaxed);
 	}
-	Sound::unlock();
+	stream.cv.notify_one();
+	return start(nullptr, float(AUDIO_RATE), &stream, stream.plays, loop, volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), Sound::Bus::Music);
 }
 
-void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+Sound::PlayingSample Sound::play(Stream &stream, float volume, float pan) {
+	return start(stream, false, volume, pan);
 }
 
-void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+Sound::PlayingSample Sound::loop(Stream &stream, float volume, float pan) {
+	return start(stream, true, volume, pan);
 }
 
-void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+void Sound::stop_all_samples() {
+	send(Command::StopAll, PlayingSample(), glm::vec3(0.0f), 0.0f);
 }
 
-void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
+void Sound::set_volume(float new_volume, float ramp) {
+	send(Command::SetGlobalVolume, PlayingSample(), glm::vec3(new_volume), ramp);
+}
+
+void Sound::set_bus_volume(Bus bus, float new_volume, float ramp) {
+	if (bus == Bus::Master) {
+		set_volume(new_volume, ramp);
+		return;
+	}
+	Command command;
+	command.type = Command::SetBusVolume;
+	command.bus = bus;
+	command.value = glm::vec3(new_volume);
+	command.ramp = ramp;
+	send(command);
+}
+
+void Sound::set_bus_effect(Bus bus, uint32_t slot, Effect const &effect) {
+	if (slot >= EffectSlots) {
+		throw std::runtime_error("Effect slot " + std::to_string(slot) + " is out of range (buses have " + std::to_string(EffectSlots) + ").");
+	}
+	Command command;
+	command.type = Command::SetBusEffect;
+	command.bus = bus;
+	command.slot = slot;
+	command.effect = effect;
+	send(command);
+}
+
+//helper: hand the audio thread a new reverb (or nullptr to turn it off), then delete reverbs it has finished with:
+static void switch_reverb(std::unique_ptr< Convolver > &&convolver) {
+	reverb_serial += 1;
+
+	Command command;
+	command.type = Command::SetReverb;
+	command.reverb = convolver.get();
+	command.serial = reverb_serial;
+	if (convolver) reverbs.emplace_back(reverb_serial, std::move(convolver));
+	send(command);
+
+	uint32_t in_use = reverb_in_use.load(std::memory_order_acquire);
+	reverbs.erase(std::remove_if(reverbs.begin(), reverbs.end(), [&](auto const &r) { return r.first < in_use; }), reverbs.end());
+}
+
+void Sound::set_reverb(Sample const &impulse_response) {
+	//the convolver works at the output rate, so resample the response if needed:
+	std::vector< float > response;
+	if (impulse_response.rate == float(AUDIO_RATE) || impulse_response.data.empty()) {
+		response = impulse_response.data;
 	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
+		std::vector< float > const &data = impulse_response.data;
+		double const pi = 3.14159265358979323846;
+		double step = double(impulse_response.rate) / double(AUDIO_RATE); //(input samples per output sample)
+		//windowed-sinc filter (like sinc_table, below, but wider), cut off at the lower of the two rates' Nyquist
+		// frequencies, so downsampling doesn't alias:
+		double cutoff = std::min(1.0, 1.0 / step);
+		double half_width = 8.0 / cutoff; //(in input samples)
+		//an impulse response's taps are spread over more (or fewer) samples at the new rate, so scale them to keep its loudness:
+		double gain = step;
+
+		response.resize(size_t(std::ceil(double(data.size()) / step)));
+		for (size_t s = 0; s < response.size(); ++s) {
+			double at = double(s) * step;
+			int64_t first = std::max(int64_t(0), int64_t(std::ceil(at - half_width)));
+			int64_t last = std::min(int64_t(data.size()) - 1, int64_t(std::floor(at + half_width)));
+			double sum = 0.0;
+			for (int64_t i = first; i <= last; ++i) {
+				double x = double(i) - at;
+				double sinc = (x == 0.0 ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x));
+				double window = 0.42 + 0.5 * std::cos(pi * x / half_width) + 0.08 * std::cos(2.0 * pi * x / half_width);
+				sum += double(data[i]) * cutoff * sinc * window;
+			}
+			response[s] = float(gain * sum);
+		}
 	}
-	Sound::unlock();
+	switch_reverb(std::make_unique< Convolver >(response));
+}
+
+void Sound::clear_reverb() {
+	switch_reverb(nullptr);
+}
+
+void Sound::set_max_real_voices(uint32_t count) {
+	send(Command::SetMaxRealVoices, PlayingSample(), glm::vec3(float(std::min(count, MaxVoices))), 0.0f);
+}
+
+//------------------
+
+void Sound::PlayingSample::set_volume(float new_volume, float ramp) const {
+	if (stopped()) return;
+	send(Command::SetVolume, *this, glm::vec3(new_volume), ramp);
+}
+
+void Sound::PlayingSample::set_pan(float new_pan, float ramp) const {
+	if (stopped()) return;
+	send(Command::SetPan, *this, glm::vec3(new_pan), ramp);
+}
+
+void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) const {
+	if (stopped()) return;
+	send(Command::SetPosition, *this, new_position, ramp);
+}
+
+void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) const {
+	if (stopped()) return;
+	send(Command::SetHalfVolumeRadius, *this, glm::vec3(new_radius), ramp);
+}
+
+void Sound::PlayingSample::set_priority(float new_priority) const {
+	if (stopped()) return;
+	send(Command::SetPriority, *this, glm::vec3(new_priority), 0.0f);
+}
+
+void Sound::PlayingSample::set_pitch(float new_pitch, float ramp) const {
+	if (stopped()) return;
+	send(Command::SetPitch, *this, glm::vec3(new_pitch), ramp);
+}
+
+void Sound::PlayingSample::set_interpolation(Interpolation interpolation) const {
+	if (stopped()) return;
+	send(Command::SetInterpolation, *this, glm::vec3(float(interpolation)), 0.0f);
+}
+
+void Sound::PlayingSample::set_bus(Bus bus) const {
+	if (stopped()) return;
+	Command command;
+	command.type = Command::SetBus;
+	command.slot = slot;
+	command.generation = generation;
+	command.bus = bus;
+	send(command);
+}
+
+void Sound::PlayingSample::set_reverb_send(float new_send, float ramp) const {
+	if (stopped()) return;
+	send(Command::SetReverbSend, *this, glm::vec3(new_send), ramp);
+}
+
+void Sound::PlayingSample::stop(float ramp) const {
+	if (stopped()) return;
+	send(Command::Stop, *this, glm::vec3(0.0f), ramp);
+}
+
+bool Sound::PlayingSample::stopped() const {
+	if (slot >= MaxVoices) return true;
+	return generations[slot].load(std::memory_order_acquire) != generation;
 }
 
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
-	position.set(new_position, ramp);
+	Command command;
+	command.type = Command::SetListener;
+	command.value = new_position;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.value2 = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.value2 = glm::normalize(new_right);
 	}
-	Sound::unlock();
+	command.ramp = ramp;
+	send(command);
 }
 
 //------------------------ internals --------------------------------
@@ -310,23 +818,464 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 }
 
 
+//helper: (re)configure a bus effect slot:
+static void set_effect(EffectState &state, Sound::Effect const &effect) {
+	if (effect.type != state.effect.type) {
+		//a different effect; start it from a clean state:
+		state = EffectState();
+		if (effect.type == Sound::Effect::Limiter) state.envelope = 1.0f;
+	}
+	state.effect = effect;
+
+	//per-sample smoothing factor for a time constant of 'seconds':
+	auto smoothing = [](float seconds) {
+		return (seconds > 0.0f ? std::exp(-1.0f / (seconds * float(AUDIO_RATE))) : 0.0f);
+	};
+
+	if (effect.type == Sound::Effect::LowPass) {
+		//biquad coefficients from the "Audio EQ Cookbook" (Q = 1/sqrt(2), for a Butterworth response):
+		float frequency = std::max(10.0f, std::min(0.45f * float(AUDIO_RATE), effect.frequency));
+		float w0 = 2.0f * 3.1415926f * frequency / float(AUDIO_RATE);
+		float alpha = std::sin(w0) / (2.0f * 0.70710678f);
+		float a0 = 1.0f + alpha;
+		state.b0 = (1.0f - std::cos(w0)) / 2.0f / a0;
+		state.b1 = (1.0f - std::cos(w0)) / a0;
+		state.b2 = state.b0;
+		state.a1 = -2.0f * std::cos(w0) / a0;
+		state.a2 = (1.0f - alpha) / a0;
+	} else if (effect.type == Sound::Effect::Compressor) {
+		state.attack_coef = smoothing(effect.attack);
+		state.release_coef = smoothing(effect.release);
+	} else if (effect.type == Sound::Effect::Limiter) {
+		state.release_coef = smoothing(effect.release);
+	}
+}
+
+//helper: run a bus effect on a block of the bus's mix:
+static void apply_effect(EffectState &state, LR *mix) {
+	Sound::Effect const &effect = state.effect;
+	if (effect.type == Sound::Effect::LowPass) {
+		//transposed direct form II, per channel:
+		for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+			LR x = mix[s];
+			LR y;
+			y.l = state.b0 * x.l + state.z1.l;
+			y.r = state.b0 * x.r + state.z1.r;
+			state.z1.l = state.b1 * x.l - state.a1 * y.l + state.z2.l;
+			state.z1.r = state.b1 * x.r - state.a1 * y.r + state.z2.r;
+			state.z2.l = state.b2 * x.l - state.a2 * y.l;
+			state.z2.r = state.b2 * x.r - state.a2 * y.r;
+			mix[s] = y;
+		}
+		//flush tiny values in the filter's tail, so they don't become (slow) denormals:
+		for (float *z : { &state.z1.l, &state.z1.r, &state.z2.l, &state.z2.r }) {
+			if (std::abs(*z) < 1e-20f) *z = 0.0f;
+		}
+	} else if (effect.type == Sound::Effect::Compressor) {
+		float slope = 1.0f - 1.0f / std::max(1.0f, effect.ratio);
+		for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+			//gain reduction (in dB) wanted for this sample's level:
+			float level = std::max(std::abs(mix[s].l), std::abs(mix[s].r));
+			float over = 20.0f * std::log10(std::max(level, 1e-6f)) - effect.threshold;
+			float target = (over > 0.0f ? over * slope : 0.0f);
+			//...approached at the attack or release rate:
+			float coef = (target > state.envelope ? state.attack_coef : state.release_coef);
+			state.envelope = target + coef * (state.envelope - target);
+			float gain = std::pow(10.0f, -state.envelope / 20.0f);
+			mix[s].l *= gain;
+			mix[s].r *= gain;
+		}
+	} else if (effect.type == Sound::Effect::Limiter) {
+		float ceiling = std::pow(10.0f, effect.threshold / 20.0f);
+		for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+			float level = std::max(std::abs(mix[s].l), std::abs(mix[s].r));
+			float target = (level > ceiling ? ceiling / level : 1.0f);
+			if (target < state.envelope) {
+				state.envelope = target; //clamp down right away...
+			} else {
+				state.envelope = target + state.release_coef * (state.envelope - target); //...and recover gradually
+			}
+			mix[s].l *= state.envelope;
+			mix[s].r *= state.envelope;
+		}
+	}
+}
+
+//helper: apply a command from the game thread (on the audio thread):
+static void execute(Command const &command) {
+	if (command.type == Command::SetGlobalVolume) {
+		Sound::volume.set(command.value.x, command.ramp);
+		return;
+	} else if (command.type == Command::SetBusVolume) {
+		buses[uint32_t(command.bus)].volume.set(command.value.x, command.ramp);
+		return;
+	} else if (command.type == Command::SetBusEffect) {
+		assert(command.slot < Sound::EffectSlots);
+		set_effect(buses[uint32_t(command.bus)].effects[command.slot], command.effect);
+		return;
+	} else if (command.type == Command::SetReverb) {
+		reverb = command.reverb;
+		reverb_in_use.store(command.serial, std::memory_order_release);
+		return;
+	} else if (command.type == Command::SetMaxRealVoices) {
+		max_real_voices = uint32_t(command.value.x);
+		return;
+	} else if (command.type == Command::SetListener) {
+		Sound::listener.position.set(command.value, command.ramp);
+		Sound::listener.right.set(command.value2, command.ramp);
+		return;
+	} else if (command.type == Command::StopAll) {
+		for (uint32_t a = 0; a < active_count; ++a) {
+			Command stop;
+			stop.type = Command::Stop;
+			stop.slot = active[a];
+			stop.generation = generations[active[a]].load(std::memory_order_relaxed);
+			stop.ramp = 1.0f / 60.0f;
+			execute(stop);
+		}
+		return;
+	}
+
+	//the rest of the commands refer to a voice:
+	assert(command.slot < Sound::MaxVoices);
+	if (generations[command.slot].load(std::memory_order_relaxed) != command.generation) return; //voice has already finished
+	Voice &voice = voices[command.slot];
+	bool is_2D = (voice.pan.value == voice.pan.value);
+
+	switch (command.type) {
+		case Command::Play:
+			assert(command.stream || (command.data && !command.data->empty()));
+			voice = Voice();
+			voice.data = command.data;
+			voice.stream = command.stream;
+			voice.play = command.play;
+			if (voice.stream) {
+				//this voice takes over the stream from any earlier play:
+				voice.stream->voice = command.slot;
+			}
+			voice.loop = command.loop;
+			voice.rate = command.rate;
+			voice.bus = command.bus;
+			voice.volume = Sound::Ramp< float >(command.value2.x);
+			voice.pan = Sound::Ramp< float >(command.value2.y);
+			voice.position = Sound::Ramp< glm::vec3 >(command.value);
+			voice.half_volume_radius = Sound::Ramp< float >(command.value2.z);
+			assert(active_count < Sound::MaxVoices);
+			active[active_count++] = command.slot;
+			break;
+		case Command::SetVolume:
+			if (!voice.stopping) {
+				voice.volume.set(command.value.x, command.ramp);
+			}
+			break;
+		case Command::SetPan:
+			if (!is_2D) break; //ignore if not in '2D' mode
+			voice.pan.set(command.value.x, command.ramp);
+			break;
+		case Command::SetPosition:
+			if (is_2D) break; //ignore if not in '3D' mode
+			voice.position.set(command.value, command.ramp);
+			break;
+		case Command::SetHalfVolumeRadius:
+			if (is_2D) break; //ignore if not in '3D' mode
+			voice.half_volume_radius.set(command.value.x, command.ramp);
+			break;
+		case Command::SetPitch:
+			voice.pitch.set(std::max(0.0f, command.value.x), command.ramp);
+			break;
+		case Command::SetInterpolation:
+			voice.interpolation = Sound::Interpolation(uint8_t(command.value.x));
+			break;
+		case Command::SetBus:
+			voice.bus = command.bus;
+			break;
+		case Command::SetPriority:
+			voice.priority = command.value.x;
+			break;
+		case Command::SetReverbSend:
+			voice.reverb_send.set(std::max(0.0f, command.value.x), command.ramp);
+			break;
+		case Command::Stop:
+			if (!voice.stopping) {
+				voice.stopping = true;
+				voice.volume.target = 0.0f;
+				voice.volume.ramp = command.ramp;
+			} else {
+				voice.volume.ramp = std::min(voice.volume.ramp, command.ramp);
+			}
+			break;
+		default:
+			assert(0 && "unhandled command");
+	}
+}
+
+//helper: the mixing kernel -- add 'count' mono samples from 'src' into stereo 'dst',
+// with the left/right gains of frame k being gain + k * gain_step:
+// (no wraparound or end-of-sample checks; callers split playback into runs that don't need them)
+void mix_mono_to_stereo(LR *dst, float const *src, uint32_t count, LR gain, LR const &gain_step) {
+	uint32_t k = 0;
+#ifdef SOUND_MIX_SSE2
+	//four frames (two output vectors) per iteration:
+	// gains for frames k, k+1 are in one vector as (l, r, l + step.l, r + step.r)
+	__m128 g01 = _mm_setr_ps(gain.l, gain.r, gain.l + gain_step.l, gain.r + gain_step.r);
+	__m128 step2 = _mm_setr_ps(2.0f * gain_step.l, 2.0f * gain_step.r, 2.0f * gain_step.l, 2.0f * gain_step.r);
+	__m128 g23 = _mm_add_ps(g01, step2);
+	__m128 step4 = _mm_add_ps(step2, step2);
+	float *out = reinterpret_cast< float * >(dst);
+	for (; k + 4 <= count; k += 4) {
+		__m128 x = _mm_loadu_ps(src + k); //s0 s1 s2 s3
+		__m128 x01 = _mm_unpacklo_ps(x, x); //s0 s0 s1 s1
+		__m128 x23 = _mm_unpackhi_ps(x, x); //s2 s2 s3 s3
+		__m128 o01 = _mm_loadu_ps(out + 2 * k);
+		__m128 o23 = _mm_loadu_ps(out + 2 * k + 4);
+		o01 = _mm_add_ps(o01, _mm_mul_ps(g01, x01));
+		o23 = _mm_add_ps(o23, _mm_mul_ps(g23, x23));
+		_mm_storeu_ps(out + 2 * k, o01);
+		_mm_storeu_ps(out + 2 * k + 4, o23);
+		g01 = _mm_add_ps(g01, step4);
+		g23 = _mm_add_ps(g23, step4);
+	}
+	//(pick up the gain where the vector loop left off)
+	gain.l += float(k) * gain_step.l;
+	gain.r += float(k) * gain_step.r;
+#endif
+	//scalar fallback (and remainder):
+	for (; k < count; ++k) {
+		dst[k].l += gain.l * src[k];
+		dst[k].r += gain.r * src[k];
+		gain.l += gain_step.l;
+		gain.r += gain_step.r;
+	}
+}
+
+//helper: add a block of one voice's mix ('src') to its bus ('dst') and, scaled by a send level of send + k * send_step, to 'send_dst':
+void mix_send(LR *dst, LR *send_dst, LR const *src, float send, float send_step) {
+	uint32_t k = 0;
+#ifdef SOUND_MIX_SSE2
+	//two frames per vector, so frames k, k+1 have send levels (send, send, send + step, send + step):
+	__m128 g = _mm_setr_ps(send, send, send + send_step, send + send_step);
+	__m128 step2 = _mm_set1_ps(2.0f * send_step);
+	float *out = reinterpret_cast< float * >(dst);
+	float *send_out = reinterpret_cast< float * >(send_dst);
+	float const *in = reinterpret_cast< float const * >(src);
+	for (; k + 2 <= MIX_SAMPLES; k += 2) {
+		__m128 x = _mm_loadu_ps(in + 2 * k);
+		_mm_storeu_ps(out + 2 * k, _mm_add_ps(_mm_loadu_ps(out + 2 * k), x));
+		_mm_storeu_ps(send_out + 2 * k, _mm_add_ps(_mm_loadu_ps(send_out + 2 * k), _mm_mul_ps(g, x)));
+		g = _mm_add_ps(g, step2);
+	}
+	send += float(k) * send_step;
+#endif
+	for (; k < MIX_SAMPLES; ++k) {
+		dst[k].l += src[k].l;
+		dst[k].r += src[k].r;
+		send_dst[k].l += send * src[k].l;
+		send_dst[k].r += send * src[k].r;
+		send += send_step;
+	}
+}
+
+//windowed-sinc resampling filter, tabulated for SINC_PHASES + 1 evenly-spaced fractional positions:
+// (row p holds the weights of data[i - SINC_TAPS/2 + 1] ... data[i + SINC_TAPS/2] when reading at i + p / SINC_PHASES)
+constexpr uint32_t SINC_TAPS = 8;
+constexpr uint32_t SINC_PHASES = 1024;
+static std::array< std::array< float, SINC_TAPS >, SINC_PHASES + 1 > const sinc_table = [](){
+	std::array< std::array< float, SINC_TAPS >, SINC_PHASES + 1 > table;
+	double const pi = 3.14159265358979323846;
+	double const half_width = SINC_TAPS / 2;
+	for (uint32_t p = 0; p <= SINC_PHASES; ++p) {
+		double sum = 0.0;
+		for (uint32_t t = 0; t < SINC_TAPS; ++t) {
+			//distance from the read position to the tap:
+			double x = double(t) - (half_width - 1.0) - double(p) / double(SINC_PHASES);
+			double sinc = (x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x));
+			//Blackman window, which reaches zero at +/- half_width:
+			double window = 0.42 + 0.5 * std::cos(pi * x / half_width) + 0.08 * std::cos(2.0 * pi * x / half_width);
+			table[p][t] = float(sinc * window);
+			sum += sinc * window;
+		}
+		//normalize so a constant signal stays constant:
+		for (auto &w : table[p]) {
+			w = float(w / sum);
+		}
+	}
+	return table;
+}();
+
+//helper: data value at index 'j', which may be past either end of the data (where it either loops or is silent):
+inline float data_at(std::vector< float > const &data, int64_t j, bool loop) {
+	int64_t size = int64_t(data.size());
+	if (j >= 0 && j < size) return data[size_t(j)];
+	if (!loop) return 0.0f;
+	j %= size;
+	if (j < 0) j += size;
+	return data[size_t(j)];
+}
+
+//helper: mix the next block of a voice's data, resampled to the output rate (or just skip over it, if !audible);
+// returns true once the data has run out:
+static bool mix_resampled(Voice &voice, bool audible, LR *buffer, LR pan, LR const &pan_step) {
+	std::vector< float > const &data = *voice.data;
+	uint32_t size = uint32_t(data.size());
+
+	//playback speed moves linearly from start_step to end_step over the block:
+	double step = voice.start_step;
+	double step_step = (double(voice.end_step) - double(voice.start_step)) / MIX_SAMPLES;
+
+	if (!audible) {
+		//no need to go sample-by-sample to find where the block ends:
+		double advance = voice.frac + MIX_SAMPLES * step + step_step * (MIX_SAMPLES * (MIX_SAMPLES - 1) / 2.0);
+		uint64_t whole = uint64_t(advance);
+		voice.frac = advance - double(whole);
+		uint64_t i = voice.i + whole;
+		if (i >= size) {
+			if (!voice.loop) return true;
+			i %= size;
+		}
+		voice.i = uint32_t(i);
+		return false;
+	}
+
+	//(working on copies, since the compiler can't tell that writes to 'buffer' don't change 'voice';
+	// position and speed are 32.32 fixed point in the loop, which keeps its dependency chain short)
+	float const *src = data.data();
+	uint32_t i = voice.i;
+	uint64_t frac = uint64_t(voice.frac * 4294967296.0);
+	int64_t fixed_step = int64_t(step * 4294967296.0);
+	int64_t fixed_step_step = int64_t(step_step * 4294967296.0);
+	bool loop = voice.loop;
+	bool sinc = (voice.interpolation == Sound::Interpolation::Sinc);
+	bool finished = false;
+	for (uint32_t k = 0; k < MIX_SAMPLES; ++k) {
+		float value = 0.0f;
+		if (sinc) {
+			static_assert(SINC_PHASES == (1 << 10), "phase is the top 10 bits of frac (rounded)");
+			auto const &taps = sinc_table[(frac + (1 << 21)) >> 22];
+			int64_t first = int64_t(i) - int64_t(SINC_TAPS / 2 - 1);
+			if (first >= 0 && first + SINC_TAPS <= size) {
+				for (uint32_t t = 0; t < SINC_TAPS; ++t) {
+					value += taps[t] * src[first + t];
+				}
+			} else {
+				//(near the ends of the data)
+				for (uint32_t t = 0; t < SINC_TAPS; ++t) {
+					value += taps[t] * data_at(data, first + t, loop);
+				}
+			}
+		} else {
+			float a = src[i];
+			float b = (i + 1 < size ? src[i + 1] : data_at(data, int64_t(i) + 1, loop));
+			value = a + float(frac) * (1.0f / 4294967296.0f) * (b - a);
+		}
+		buffer[k].l += pan.l * value;
+		buffer[k].r += pan.r * value;
+		pan.l += pan_step.l;
+		pan.r += pan_step.r;
+
+		//advance playback position:
+		frac += uint64_t(fixed_step);
+		fixed_step += fixed_step_step;
+		i += uint32_t(frac >> 32);
+		frac &= 0xffffffffULL;
+		if (i >= size) {
+			if (!loop) {
+				finished = true;
+				break;
+			}
+			i %= size;
+		}
+	}
+	voice.i = i;
+	voice.frac = double(frac) / 4294967296.0;
+	return finished;
+}
+
+//helper: mix the next block of a streaming voice into 'buffer' (or just skip over it, if !audible); returns true once the stream has ended:
+static bool mix_stream(Voice &voice, uint32_t slot, bool audible, LR *buffer, LR pan, LR const &pan_step) {
+	Sound::Stream &stream = *voice.stream;
+
+	//a later play of the stream has taken over:
+	if (stream.voice != slot) return true;
+
+	uint32_t head = stream.head.load(std::memory_order_relaxed);
+	uint32_t tail;
+	for (;;) {
+		tail = stream.tail.load(std::memory_order_acquire);
+		if (!voice.synced) {
+			//skip samples decoded for earlier plays:
+			uint64_t started = stream.started.load(std::memory_order_acquire);
+			if (uint32_t(started >> 32) == voice.play) {
+				head = uint32_t(started);
+				tail = stream.tail.load(std::memory_order_acquire);
+				voice.synced = true;
+			} else {
+				//(the decoder hasn't rewound yet, so everything up to 'tail' is left over)
+				head = tail;
+			}
+			stream.head.store(head, std::memory_order_release);
+		}
+		if (!offline) break;
+
+		//when rendering offline, wait for the decoder rather than leave a gap, so output is deterministic:
+		if (stream.failed.load(std::memory_order_acquire) == voice.play) break;
+		if (voice.synced) {
+			if (tail - head >= MIX_SAMPLES) break;
+			if (stream.ended.load(std::memory_order_acquire) == voice.play) {
+				tail = stream.tail.load(std::memory_order_acquire);
+				break;
+			}
+		}
+		std::this_thread::yield();
+	}
+
+	if (voice.synced) {
+		//mix in runs that stop at the end of the ring buffer:
+		// (if decoding has fallen behind, the rest of the block is left silent)
+		uint32_t mixed = 0;
+		while (mixed < MIX_SAMPLES && head != tail) {
+			uint32_t offset = head & (Sound::Stream::Capacity - 1);
+			uint32_t count = std::min({ MIX_SAMPLES - mixed, tail - head, Sound::Stream::Capacity - offset });
+			if (audible) mix_mono_to_stereo(buffer + mixed, stream.ring.data() + offset, count, pan, pan_step);
+
+			mixed += count;
+			head += count;
+
+			pan.l += float(count) * pan_step.l;
+			pan.r += float(count) * pan_step.r;
+		}
+	}
+	stream.head.store(head, std::memory_order_release);
+
+	//a play that failed to decode ends once whatever was decoded has played (or right away, if it never started):
+	if (stream.failed.load(std::memory_order_acquire) == voice.play) {
+		return !voice.synced || head == stream.tail.load(std::memory_order_acquire);
+	}
+	return voice.synced
+		&& stream.ended.load(std::memory_order_acquire) == voice.play
+		&& !stream.looping.load(std::memory_order_relaxed)
+		&& head == stream.tail.load(std::memory_order_acquire);
+}
+
 //The audio callback -- invoked by SDL when it needs more sound to play:
 void mix_audio(void *, Uint8 *buffer_, int len) {
 	assert(buffer_); //should always have some audio buffer
 
-	struct LR {
-		float l;
-		float r;
-	};
-	static_assert(sizeof(LR) == 8, "Sample is packed");
 	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
 	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
-	//zero the output buffer:
+	//apply changes queued by the game thread:
+	execute_queued();
+
+	//zero the output buffer (the Master bus) and the other buses:
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
 		buffer[s].l = 0.0f;
 		buffer[s].r = 0.0f;
 	}
+	for (auto &bus : buses) {
+		if (&bus == &buses[uint32_t(Sound::Bus::Master)]) continue;
+		bus.mix.fill(LR{ 0.0f, 0.0f });
+	}
+	if (reverb) reverb_input.fill(LR{ 0.0f, 0.0f });
 
 	//update global values:
 	float start_volume = Sound::volume.value;
@@ -341,12 +1290,27 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	glm::vec3 end_position =  Sound::listener.position.value;
 	glm::vec3 end_right =  Sound::listener.right.value;
 
-	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
+	//bus volumes, and how much louder or quieter than their voices' gains each bus will be heard:
+	std::array< float, Sound::BusCount > bus_start_volume, bus_end_volume, bus_scale;
+	for (uint32_t b = 0; b < Sound::BusCount; ++b) {
+		if (b == uint32_t(Sound::Bus::Master)) {
+			bus_start_volume[b] = bus_end_volume[b] = 1.0f;
+		} else {
+			bus_start_volume[b] = buses[b].volume.value;
+			step_value_ramp(buses[b].volume);
+			bus_end_volume[b] = buses[b].volume.value;
+		}
+		bus_scale[b] = std::max(bus_start_volume[b], bus_end_volume[b]) * std::max(start_volume, end_volume);
+	}
+
+	//figure out each voice's panning/volume at the start and end of the mix period:
+	std::array< uint32_t, Sound::MaxVoices > audible;
+	uint32_t audible_count = 0;
+	for (uint32_t a = 0; a < active_count; ++a) {
+		Voice &playing_sample = voices[active[a]];
 
 		//Figure out sample panning/volume at start...
-		LR start_pan;
+		LR &start_pan = playing_sample.start_gain;
 		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
 			//3D panning
 			compute_pan_from_listener_and_position(
@@ -363,13 +1327,23 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 
 			step_value_ramp(playing_sample.pan);
 		}
-		start_pan.l *= start_volume * playing_sample.volume.value;
-		start_pan.r *= start_volume * playing_sample.volume.value;
+		start_pan.l *= playing_sample.volume.value;
+		start_pan.r *= playing_sample.volume.value;
 
 		step_value_ramp(playing_sample.volume);
 
+		//playback speed also ramps over the block:
+		playing_sample.start_step = playing_sample.rate * playing_sample.pitch.value;
+		step_value_ramp(playing_sample.pitch);
+		playing_sample.end_step = playing_sample.rate * playing_sample.pitch.value;
+
+		//...as does the reverb send:
+		playing_sample.start_send = playing_sample.reverb_send.value;
+		step_value_ramp(playing_sample.reverb_send);
+		playing_sample.end_send = playing_sample.reverb_send.value;
+
 		//..and end of the mix period:
-		LR end_pan;
+		LR &end_pan = playing_sample.end_gain;
 		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
 			//3D panning
 			compute_pan_from_listener_and_position(
@@ -382,8 +1356,48 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
 		}
 
-		end_pan.l *= end_volume * playing_sample.volume.value;
-		end_pan.r *= end_volume * playing_sample.volume.value;
+		end_pan.l *= playing_sample.volume.value;
+		end_pan.r *= playing_sample.volume.value;
+
+		playing_sample.mix = false;
+		playing_sample.loudness = std::max({ start_pan.l, start_pan.r, end_pan.l, end_pan.r }) * bus_scale[uint32_t(playing_sample.bus)];
+		if (playing_sample.loudness > INAUDIBLE_GAIN) {
+			audible[audible_count++] = active[a];
+		}
+	}
+
+	//only mix the most important audible voices:
+	if (audible_count > max_real_voices) {
+		auto more_important = [](uint32_t a, uint32_t b) {
+			Voice const &va = voices[a];
+			Voice const &vb = voices[b];
+			if (va.priority != vb.priority) return va.priority > vb.priority;
+			return va.loudness > vb.loudness;
+		};
+		std::nth_element(audible.begin(), audible.begin() + max_real_voices, audible.begin() + audible_count, more_important);
+		audible_count = max_real_voices;
+	}
+	for (uint32_t a = 0; a < audible_count; ++a) {
+		voices[audible[a]].mix = true;
+	}
+
+	//add audio from each real voice into the buffer (and advance virtual voices without mixing them):
+	for (uint32_t a = 0; a < active_count; /* later */) {
+		Voice &playing_sample = voices[active[a]];
+
+		LR start_pan = playing_sample.start_gain;
+		LR end_pan = playing_sample.end_gain;
+
+		//fade voices in or out over the block when they become real or virtual, to avoid clicks:
+		bool audible = true;
+		if (playing_sample.mix) {
+			if (playing_sample.state == Voice::Virtual) start_pan = LR{ 0.0f, 0.0f };
+			playing_sample.state = Voice::Real;
+		} else {
+			if (playing_sample.state == Voice::Real) end_pan = LR{ 0.0f, 0.0f };
+			else audible = false;
+			playing_sample.state = Voice::Virtual;
+		}
 
 		//figure out a step to add at each sample so that pan will move smoothly from start to end:
 		LR pan = start_pan;
@@ -391,38 +1405,97 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
 		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
 
-		assert(playing_sample.i < playing_sample.data.size());
-
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
-
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
-				} else {
-					break;
+		//voices are mixed into their bus:
+		LR *bus_mix = (playing_sample.bus == Sound::Bus::Master ? buffer : buses[uint32_t(playing_sample.bus)].mix.data());
+		//...by way of voice_mix, if some of the voice also goes to the reverb:
+		bool sends = reverb && audible && (playing_sample.start_send > 0.0f || playing_sample.end_send > 0.0f);
+		if (sends) voice_mix.fill(LR{ 0.0f, 0.0f });
+		LR *out = (sends ? voice_mix.data() : bus_mix);
+
+		bool finished;
+		if (playing_sample.stream) {
+			finished = mix_stream(playing_sample, active[a], audible, out, pan, pan_step);
+		} else if (playing_sample.start_step != 1.0f || playing_sample.end_step != 1.0f || playing_sample.frac != 0.0) {
+			finished = mix_resampled(playing_sample, audible, out, pan, pan_step);
+		} else {
+			//playing at the output rate, so no resampling needed:
+			std::vector< float > const &data = *playing_sample.data;
+			assert(playing_sample.i < data.size());
+
+			//mix in runs that stop at the end of the sample data, so the kernel doesn't need to check:
+			uint32_t mixed = 0;
+			while (mixed < MIX_SAMPLES) {
+				uint32_t count = std::min(MIX_SAMPLES - mixed, uint32_t(data.size()) - playing_sample.i);
+				if (audible) mix_mono_to_stereo(out + mixed, data.data() + playing_sample.i, count, pan, pan_step);
+
+				//update position in sample:
+				mixed += count;
+				playing_sample.i += count;
+				if (playing_sample.i == data.size()) {
+					if (playing_sample.loop) {
+						playing_sample.i = 0;
+					} else {
+						break;
+					}
 				}
+
+				//update pan values:
+				pan.l += float(count) * pan_step.l;
+				pan.r += float(count) * pan_step.r;
 			}
+			finished = (playing_sample.i >= data.size());
+		}
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+		if (sends) {
+			//the send follows the bus's volume (so turning a bus down also turns down its voices' reverb),
+			// but skips the bus's effects, since the reverb goes straight to Master:
+			// (the product of the two ramps is approximated by a ramp between their products)
+			uint32_t b = uint32_t(playing_sample.bus);
+			float start_send = playing_sample.start_send * bus_start_volume[b];
+			float end_send = playing_sample.end_send * bus_end_volume[b];
+			mix_send(bus_mix, reverb_input.data(), voice_mix.data(), start_send, (end_send - start_send) / MIX_SAMPLES);
 		}
 
-		if (playing_sample.i >= playing_sample.data.size()
-		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
+		if (finished || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
+			//invalidate handles and hand the slot back to the game thread:
+			retire_voice(a);
 		} else {
-			++si;
+			++a;
+		}
+	}
+
+	//run each bus's effects, then mix it into Master at the bus's volume:
+	for (uint32_t b = 0; b < Sound::BusCount; ++b) {
+		if (b == uint32_t(Sound::Bus::Master)) continue;
+		BusState &bus = buses[b];
+		for (auto &effect : bus.effects) {
+			apply_effect(effect, bus.mix.data());
 		}
+		float gain = bus_start_volume[b];
+		float gain_step = (bus_end_volume[b] - bus_start_volume[b]) / MIX_SAMPLES;
+		for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+			float g = gain + float(s) * gain_step;
+			buffer[s].l += g * bus.mix[s].l;
+			buffer[s].r += g * bus.mix[s].r;
+		}
+	}
+
+	//the reverb's output also goes to Master:
+	if (reverb) {
+		reverb->process(reinterpret_cast< float const * >(reverb_input.data()), reinterpret_cast< float * >(buffer));
+	}
+
+	//apply the global volume, then Master's effects:
+	if (start_volume != 1.0f || end_volume != 1.0f) {
+		float gain_step = (end_volume - start_volume) / MIX_SAMPLES;
+		for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+			float g = start_volume + float(s) * gain_step;
+			buffer[s].l *= g;
+			buffer[s].r *= g;
+		}
+	}
+	for (auto &effect : buses[uint32_t(Sound::Bus::Master)].effects) {
+		apply_effect(effect, buffer);
 	}
 
 	/*//DEBUG: report output power:
@@ -430,7 +1503,7 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
 		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
+	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << active_count << std::endl; //DEBUG
 	*/
 
 }
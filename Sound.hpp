@@ -2,11 +2,18 @@
 
 #include <glm/glm.hpp>
 
+#include <atomic>
+#include <condition_variable>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <string>
 #include <cmath>
 
+struct OpusReader;
+
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
 
@@ -15,14 +22,56 @@ namespace Sound {
 //Sample objects hold mono (one-channel) audio.
 struct Sample {
 	//Load from a '.wav' or '.opus' file.
-	//  will warn and convert if sound is not already 48kHz mono:
+	//  will warn and convert if sound is not already mono; keeps the file's sampling rate:
 	Sample(std::string const &filename);
 	
 	//Directly supply an audio buffer:
-	Sample(std::vector< float > const &data);
+	Sample(std::vector< float > const &data, float rate = 48000.0f);
 
-	//sample data is stored as 48kHz, mono, floating-point:
+	//sample data is stored as mono, floating-point:
 	std::vector< float > data;
+	//...at this sampling rate (the mixer resamples to 48kHz as it plays):
+	float rate = 48000.0f;
+};
+
+//How the mixer reads between samples when resampling (i.e., when a sample's rate isn't 48kHz, or its pitch isn't 1):
+enum class Interpolation : uint8_t {
+	Linear, //cheap; some high-frequency loss and aliasing
+	Sinc, //8-tap windowed sinc; costs several times as much as Linear
+};
+
+//Stream objects play long (e.g., music) '.opus' files without decoding the whole file up front:
+// a background thread keeps the file open and decodes a little ahead of playback.
+//NOTE: a stream is played by at most one voice; playing it again restarts it from the beginning
+// (and silences the previous playback). Destroying a stream stops (immediately, without a fade) any voice playing it.
+struct Stream {
+	Stream(std::string const &filename); //throws if the file can't be opened
+	~Stream();
+	Stream(Stream const &) = delete;
+	Stream &operator=(Stream const &) = delete;
+
+	//internals:
+	//decoded samples wait in a ring buffer of this many (~1.4 seconds at 48kHz):
+	static constexpr uint32_t Capacity = 1 << 16;
+	std::vector< float > ring;
+	std::atomic< uint32_t > head = 0; //next sample to play (written by the audio thread)
+	std::atomic< uint32_t > tail = 0; //next sample to decode (written by the decoding thread)
+
+	//each play of the stream is numbered; the decoder rewinds the file when a new play is requested:
+	uint32_t plays = 0; //plays so far (game thread only)
+	std::atomic< uint32_t > requested = 1; //most recent play requested (play 1 is decoded as soon as the stream is opened)
+	std::atomic< uint64_t > started = uint64_t(1) << 32; //(play << 32) | ring position of the first sample of that play
+	std::atomic< uint32_t > ended = 0; //play for which the end of the file has been decoded
+	std::atomic< uint32_t > failed = 0; //play that hit a decoding error (it ends once its decoded samples have played, even if looping)
+	std::atomic< bool > looping = false; //should the decoder wrap around at the end of the file?
+	uint32_t voice = -1U; //voice slot currently playing the stream (audio thread only)
+
+	std::unique_ptr< OpusReader > reader; //(decoding thread only, after construction)
+	std::mutex mutex; //wakes the decoding thread:
+	std::condition_variable cv;
+	bool quit = false; //(protected by mutex)
+	std::thread thread;
+	void decode(); //decoding thread main function
 };
 
 //Ramp<> manages values that should be smoothly interpolated
@@ -48,60 +97,104 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+//Buses group playing samples so they can be controlled and processed together:
+// each sample is mixed into its bus, and each bus runs its effects and is mixed (at its volume) into Master,
+// which then applies the global volume and its own effects.
+//Samples play on the SFX bus and streams on the Music bus unless moved with PlayingSample::set_bus.
+enum class Bus : uint8_t {
+	Music,
+	SFX,
+	UI,
+	Master,
+};
+constexpr uint32_t BusCount = 4;
+
+//Effects process a bus's whole mix, once per block:
+struct Effect {
+	enum Type : uint8_t {
+		None,
+		LowPass, //two-pole (Butterworth) low-pass filter at 'frequency'
+		Compressor, //reduces levels above 'threshold' by 'ratio', reacting over 'attack' and 'release'
+		Limiter, //keeps peaks at or below 'threshold' (reacts instantly, recovers over 'release')
+	} type = None;
+	float frequency = 1000.0f; //Hz (LowPass)
+	float threshold = -12.0f; //dB (Compressor, Limiter)
+	float ratio = 4.0f; //(Compressor)
+	float attack = 0.005f; //seconds (Compressor)
+	float release = 0.1f; //seconds (Compressor, Limiter)
+};
+//each bus has this many effect slots, which are run in order:
+constexpr uint32_t EffectSlots = 4;
+
+// 'PlayingSample' is a handle to a sample that is (or was) playing:
+// (handles are small and freely copyable; once playback finishes the handle goes stale,
+//  and the functions below do nothing)
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample;
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
-	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
+	//NOTE: these (and all other Sound:: functions that change playback) queue a command
+	// for the audio thread instead of locking, so should only be called from one thread.
+	void set_volume(float new_volume, float ramp = 1.0f / 60.0f) const;
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
-	void set_pan(float new_pan, float ramp = 1.0f / 60.0f);
+	void set_pan(float new_pan, float ramp = 1.0f / 60.0f) const;
 	//set the position of a sample (use only on samples in "3D" mode; no effect on "2D" samples):
-	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
+	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f) const;
 	//set the half-volume radius (use only on "3D" playing sounds):
-	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f);
+	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f) const;
+
+	//set the playback speed (2.0f is twice as fast and an octave up; default 1.0f; no effect on streams):
+	void set_pitch(float new_pitch, float ramp = 1.0f / 60.0f) const;
+	//set the resampling method (default Interpolation::Linear):
+	void set_interpolation(Interpolation interpolation) const;
+	//move the sample to a different bus:
+	void set_bus(Bus bus) const;
+	//set how much of the sample is also sent to the reverb (see set_reverb, below; default 0.0f):
+	// (the send follows the sample's volume and panning, and its bus's volume, but not its bus's effects)
+	void set_reverb_send(float new_send, float ramp = 1.0f / 60.0f) const;
+
+	//set the priority of a sample (default 0.0f):
+	// when more samples are audible than the mixer's real-voice budget (see set_max_real_voices, below),
+	// the highest-priority (then loudest) are mixed; the rest keep playing 'virtually' (silently).
+	void set_priority(float new_priority) const;
 
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
-	void stop(float ramp = 1.0f / 60.0f);
+	void stop(float ramp = 1.0f / 60.0f) const;
+
+	//was playback stopped (either by running out of sample, or by stop())? (safe to call from any thread)
+	bool stopped() const;
 
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	uint32_t slot = -1U; //index of the voice in the mixer's voice pool
+	uint32_t generation = 0; //slot's generation when playback started; slots are reused once this changes
 };
 
+//the mixer keeps track of at most this many playing samples at once:
+// (play() and friends return an already-stopped PlayingSample if all voices are busy)
+constexpr uint32_t MaxVoices = 512;
+
 // ------- global functions -------
 
 void init(); //call Sound::init() from main.cpp before using any member functions
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
+//The mixer works in blocks of this many (stereo) samples:
+constexpr uint32_t BlockSamples = 1024;
+
+//Mix 'blocks' blocks into 'buffer' (2 * BlockSamples * blocks floats; left, right interleaved) without an audio device,
+// as fast as possible (e.g., for tests and benchmarks). Output depends only on the calls made before each render():
+// unlike real-time playback, rendering waits for streams to decode instead of skipping ahead.
+void render(float *buffer, uint32_t blocks);
+
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+PlayingSample play(
 	Sample const &sample,
 	float volume = 1.0f,
 	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > play_3D(
+PlayingSample play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
@@ -110,19 +203,31 @@ std::shared_ptr< PlayingSample > play_3D(
 
 //Call 'Sound::loop' to play a sample ~forever~.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback.
-std::shared_ptr< PlayingSample > loop(
+PlayingSample loop(
 	Sample const &sample,
 	float volume = 1.0f,
 	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > loop_3D(
+PlayingSample loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
 	float half_volume_radius = std::numeric_limits< float >::infinity()
 );
 
+//Streams play (or loop) the same way, but only in '2D' mode:
+PlayingSample play(
+	Stream &stream,
+	float volume = 1.0f,
+	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+);
+PlayingSample loop(
+	Stream &stream,
+	float volume = 1.0f,
+	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+);
+
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
@@ -136,13 +241,32 @@ extern struct Listener listener;
 //"panic button" to shut off all currently playing sounds:
 void stop_all_samples();
 
-//set global volume:
+//set the real-voice budget -- the most samples that will be mixed (i.e., heard) at once:
+// (samples quieter than -80dB are never mixed, and don't count toward the budget)
+void set_max_real_voices(uint32_t count);
+constexpr uint32_t DefaultMaxRealVoices = 64;
+
+//set global volume (that is, the volume of the Master bus):
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
+//set the volume of a bus (set_bus_volume(Bus::Master, ...) is the same as set_volume):
+void set_bus_volume(Bus bus, float new_volume, float ramp = 1.0f / 60.0f);
+
+//put an effect in one of a bus's slots (an Effect of type None empties the slot):
+// (changing the settings of an effect without changing its type doesn't reset it)
+void set_bus_effect(Bus bus, uint32_t slot, Effect const &effect);
+
+//set the reverb's impulse response (e.g., Sample("hall.wav"); resampled -- keeping its loudness -- to 48kHz if needed):
+// samples' reverb sends are convolved with the response and mixed into Master.
+// (mixing cost grows with the response's length, though slowly: a few-second response takes a small fraction of each block's time)
+void set_reverb(Sample const &impulse_response);
+//turn the reverb off:
+void clear_reverb();
+
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+// the set_*/stop/play/... functions don't need these (they queue commands for the audio thread),
+// so you shouldn't need to call them unless your code is modifying values directly:
 void lock();
 void unlock();
 
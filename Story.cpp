@@ -0,0 +1,64 @@
+#include "Story.hpp"
+
+#include "read_write_chunk.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <streambuf>
+
+//read_chunk wants a std::istream, so present the loaded file as one without copying it:
+struct MemoryBuf : std::streambuf {
+	MemoryBuf(char *begin, char *end) {
+		setg(begin, begin, end);
+	}
+};
+
+Story::Story(std::string const &filename) {
+	//read the whole file at once:
+	std::vector< char > blob;
+	{
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		if (!file) {
+			throw std::runtime_error("Failed to open story '" + filename + "'.");
+		}
+		blob.resize(size_t(file.tellg()));
+		file.seekg(0);
+		if (!file.read(blob.data(), blob.size())) {
+			throw std::runtime_error("Failed to read story '" + filename + "'.");
+		}
+	}
+
+	MemoryBuf buf(blob.data(), blob.data() + blob.size());
+	std::istream from(&buf);
+
+	read_chunk(from, "str0", &texts);
+	read_chunk(from, "nod0", &nodes);
+
+	if (from.peek() != std::istream::traits_type::eof()) {
+		std::cerr << "WARNING: trailing data in story '" << filename << "'." << std::endl;
+	}
+
+	//check text ranges so text() doesn't need to:
+	auto check = [&](uint32_t begin, uint32_t end) {
+		if (!(begin <= end && end <= texts.size())) {
+			throw std::runtime_error("Story '" + filename + "' has a text range outside its string table.");
+		}
+	};
+	for (auto const &n : nodes) {
+		if (n.type > Node::Effect) {
+			throw std::runtime_error("Story '" + filename + "' has a node of unknown type " + std::to_string(n.type) + ".");
+		}
+		check(n.text_begin, n.text_end);
+		check(n.options[0].text_begin, n.options[0].text_end);
+		check(n.options[1].text_begin, n.options[1].text_end);
+	}
+}
+
+void Story::save(std::string const &filename) const {
+	std::ofstream file(filename, std::ios::binary);
+	write_chunk("str0", texts, &file);
+	write_chunk("nod0", nodes, &file);
+	if (!file) {
+		throw std::runtime_error("Failed to write story '" + filename + "'.");
+	}
+}
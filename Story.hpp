@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+ * A Story is the game's narrative content -- dialogue, choices, and the
+ * effects of choices -- as compiled by compile-story into a binary blob.
+ *
+ * Nodes are stored in one flat table indexed by node id; each node is a
+ * fixed-size, type-tagged record whose text lives in a shared string table.
+ * Looking up a node is an index, and its text is a view into the table, so
+ * the game can use nodes every frame without allocating or copying.
+ *
+ * File format (chunks as in read_write_chunk.hpp):
+ *   "str0" - text of every node, concatenated (no terminators)
+ *   "nod0" - Story::Node records; record i is the node with id i
+ * Text is referred to as [begin,end) ranges of bytes in the "str0" chunk.
+ *
+ * Usage:
+ *   Story story(data_path("story.bin"));
+ *   Story::Node const &node = story.node(id);
+ *   if (node.type == Story::Node::Dialogue) std::cout << story.text(node);
+ *
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+struct Story {
+	//load a compiled story (throws on error):
+	Story(std::string const &filename);
+	Story() = default;
+
+	//one of a choice's two options:
+	struct Option {
+		float prob = 0.0f; //chance of effect1 (otherwise, effect2)
+		uint32_t effect1_id = 0;
+		uint32_t effect2_id = 0;
+		uint32_t text_begin = 0, text_end = 0;
+	};
+	static_assert(sizeof(Option) == 20, "Story::Option is packed.");
+
+	//fixed-size record, stored as-is in the file:
+	struct Node {
+		enum Type : uint32_t {
+			Missing = 0, //no node has this id
+			Dialogue = 1, //text; continues to the next node in the story line
+			Choice = 2, //text and two options
+			Effect = 3, //text and stat changes; the outcome of a choice
+		} type = Missing;
+		uint32_t text_begin = 0, text_end = 0;
+		//Effect only:
+		int32_t academics = 0, social = 0, health = 0;
+		//Choice only:
+		Option options[2];
+	};
+	static_assert(sizeof(Node) == 4 + 8 + 12 + 2 * 20, "Story::Node is packed.");
+
+	std::vector< char > texts;
+	std::vector< Node > nodes;
+
+	//node with a given id (a Missing node for ids that aren't in the story):
+	Node const &node(uint32_t id) const {
+		static Node const missing;
+		return (id < nodes.size() ? nodes[id] : missing);
+	}
+
+	//text in the range [begin, end) of 'texts':
+	std::string_view text(uint32_t begin, uint32_t end) const {
+		return std::string_view(texts.data() + begin, end - begin);
+	}
+	std::string_view text(Node const &node) const { return text(node.text_begin, node.text_end); }
+	std::string_view text(Option const &option) const { return text(option.text_begin, option.text_end); }
+
+	//write in the format read by the constructor:
+	void save(std::string const &filename) const;
+};
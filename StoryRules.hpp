@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+ * The rules PlayMode follows when walking through a Story, kept separate
+ * from PlayMode so headless tools (simulate-story, solve-story) can follow
+ * exactly the same rules.
+ *
+ * A playthrough visits the nodes in StoryLine in order. Odd entries are
+ * choices; the entry after each choice is filled in with the effect that
+ * the choice led to. Pressing enter on a screen:
+ *  - at PassEvent or later: restarts the game
+ *  - if academics, social, or health (checked in that order) is <= 0:
+ *    jumps to the matching failure screen
+ *  - on a dialogue or effect screen: continues to the next event
+ *  - on a choice screen: picks the selected option's first effect with
+ *    probability 'prob' (otherwise its second effect), adds the effect's
+ *    stat changes, and continues to the effect
+ * Stats are clamped to MaxStat before they are next shown (or checked).
+ *
+ */
+
+#include <array>
+#include <cstdint>
+
+struct StoryRules {
+	//node ids of the ending screens:
+	enum : uint32_t {
+		PASS = 4,
+		FAIL_ACADEMICS = 1,
+		FAIL_SOCIAL = 2,
+		FAIL_HEALTH = 3,
+	};
+
+	//indices into StoryLine:
+	enum : uint32_t {
+		Events = 25,
+		PassEvent = 21,
+		FailAcademicsEvent = 22,
+		FailSocialEvent = 23,
+		FailHealthEvent = 24,
+	};
+
+	//node ids visited by a playthrough (0 entries after choices are replaced with effects):
+	static constexpr std::array< uint32_t, Events > StoryLine = {
+		0,
+		5, 0,
+		33, 0,
+		9, 0,
+		41, 0,
+		25, 0,
+		37, 0,
+		13, 0,
+		29, 0,
+		21, 0,
+		17, 0,
+		PASS, FAIL_ACADEMICS, FAIL_SOCIAL, FAIL_HEALTH
+	};
+
+	//stats start at StartStat and are clamped to MaxStat:
+	enum : int32_t {
+		StartStat = 100,
+		MaxStat = 100,
+	};
+};
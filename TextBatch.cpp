@@ -0,0 +1,158 @@
+#include "TextBatch.hpp"
+#include "ColorTextureProgram.hpp"
+#include "ColorTextureSDFProgram.hpp"
+
+#include "gl_errors.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+//All TextBatch instances share a vertex array object and a vertex buffer, initialized at load time:
+
+//n.b. declared static so they don't conflict with similarly named global variables elsewhere:
+static GLuint vertex_buffer = 0;
+static GLsizeiptr vertex_buffer_capacity = 0; //bytes; buffer only ever grows
+static GLuint vertex_buffer_for_color_texture_program = 0;
+
+static Load< void > setup_buffers(LoadTagDefault, [](){
+	{ //set up vertex buffer:
+		glGenBuffers(1, &vertex_buffer);
+		//for now, buffer will be un-filled.
+	}
+
+	{ //vertex array mapping buffer for color_texture_program:
+		glGenVertexArrays(1, &vertex_buffer_for_color_texture_program);
+		glBindVertexArray(vertex_buffer_for_color_texture_program);
+
+		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+
+		//color_texture_program reads position and texcoord as a single 'vertex' attribute at location 0:
+		// (so does color_texture_sdf_program, so this vertex array is used for both)
+		glVertexAttribPointer(
+			0, //attribute
+			4, //size
+			GL_FLOAT, //type
+			GL_FALSE, //normalized
+			sizeof(TextBatch::Vertex), //stride
+			(GLbyte *)0 + offsetof(TextBatch::Vertex, Position) //offset
+		);
+		glEnableVertexAttribArray(0);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		glBindVertexArray(0);
+	}
+
+	GL_ERRORS(); //PARANOIA: make sure nothing strange happened during setup
+});
+
+TextBatch::TextBatch(GlyphAtlas const &atlas_, glm::uvec2 const &drawable_size) : atlas(atlas_) {
+	projection = glm::ortho(0.0f, float(drawable_size.x), 0.0f, float(drawable_size.y));
+}
+
+void TextBatch::draw_glyph(GlyphAtlas::Glyph const &glyph, glm::vec2 const &pen, float scale) {
+	if (glyph.size.x <= 0 || glyph.size.y <= 0) return; //nothing to draw (e.g., a space)
+
+	if (page_attribs.size() <= glyph.page) page_attribs.resize(glyph.page + 1);
+	append_glyph(&page_attribs[glyph.page], glyph, pen, scale);
+}
+
+void TextBatch::draw_attribs(uint32_t page, std::vector< Vertex > const &attribs) {
+	if (attribs.empty()) return;
+
+	if (page_attribs.size() <= page) page_attribs.resize(page + 1);
+	page_attribs[page].insert(page_attribs[page].end(), attribs.begin(), attribs.end());
+}
+
+void TextBatch::append_glyph(std::vector< Vertex > *attribs_, GlyphAtlas::Glyph const &glyph, glm::vec2 const &pen, float scale) {
+	assert(attribs_);
+	auto &attribs = *attribs_;
+
+	//quad covers the glyph plus any distance field spread around it:
+	glm::vec2 spread = glm::vec2(float(glyph.spread));
+	glm::vec2 min = pen + (glm::vec2(glyph.bearing.x, glyph.bearing.y - glyph.size.y) - spread) * scale;
+	glm::vec2 max = min + (glm::vec2(glyph.size) + 2.0f * spread) * scale;
+
+	//glyph bitmaps are stored top row first:
+	glm::vec2 tex_min = glm::vec2(glyph.position) - spread;
+	glm::vec2 tex_max = glm::vec2(glyph.position) + glm::vec2(glyph.size) + spread;
+
+	attribs.emplace_back(glm::vec2(min.x, max.y), glm::vec2(tex_min.x, tex_min.y));
+	attribs.emplace_back(glm::vec2(min.x, min.y), glm::vec2(tex_min.x, tex_max.y));
+	attribs.emplace_back(glm::vec2(max.x, min.y), glm::vec2(tex_max.x, tex_max.y));
+
+	attribs.emplace_back(glm::vec2(min.x, max.y), glm::vec2(tex_min.x, tex_min.y));
+	attribs.emplace_back(glm::vec2(max.x, min.y), glm::vec2(tex_max.x, tex_max.y));
+	attribs.emplace_back(glm::vec2(max.x, max.y), glm::vec2(tex_max.x, tex_min.y));
+}
+
+void TextBatch::set_color(glm::vec3 const &color_) {
+	if (color_ == color) return;
+	flush();
+	color = color_;
+}
+
+void TextBatch::flush() {
+	//gather all pages into one array, converting texcoords from texels to [0,1]:
+	std::vector< Vertex > attribs;
+	std::vector< std::pair< GLint, GLsizei > > page_ranges(page_attribs.size(), std::make_pair(0, 0));
+	{
+		size_t total = 0;
+		for (auto const &pa : page_attribs) total += pa.size();
+		if (total == 0) return;
+		attribs.reserve(total);
+	}
+	for (uint32_t p = 0; p < page_attribs.size(); ++p) {
+		page_ranges[p].first = GLint(attribs.size());
+		page_ranges[p].second = GLsizei(page_attribs[p].size());
+		if (page_attribs[p].empty()) continue;
+		assert(p < atlas.pages.size());
+		float inv_size = 1.0f / float(atlas.pages[p].size);
+		for (auto const &v : page_attribs[p]) {
+			attribs.emplace_back(v.Position, v.TexCoord * inv_size);
+		}
+		page_attribs[p].clear();
+	}
+
+	//upload vertices to vertex_buffer with a single call, growing it if needed:
+	GLsizeiptr bytes = GLsizeiptr(attribs.size() * sizeof(attribs[0]));
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	if (bytes > vertex_buffer_capacity) {
+		vertex_buffer_capacity = std::max(bytes, 2 * vertex_buffer_capacity);
+	}
+	//(re-specifying the storage lets the driver hand us fresh memory instead of waiting for last frame's draw)
+	glBufferData(GL_ARRAY_BUFFER, vertex_buffer_capacity, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, attribs.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//draw one range per atlas page, with the program that matches the atlas' format:
+	glDisable(GL_DEPTH_TEST);
+	if (atlas.format == GlyphAtlas::DistanceField) {
+		glUseProgram(color_texture_sdf_program->program);
+		glUniformMatrix4fv(color_texture_sdf_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(projection));
+		glUniform3f(color_texture_sdf_program->Color_vec3, color.x, color.y, color.z);
+	} else {
+		glUseProgram(color_texture_program->program);
+		glUniformMatrix4fv(color_texture_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(projection));
+		glUniform3f(color_texture_program->Color_vec3, color.x, color.y, color.z);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(vertex_buffer_for_color_texture_program);
+
+	for (uint32_t p = 0; p < page_ranges.size(); ++p) {
+		if (page_ranges[p].second == 0) continue;
+		glBindTexture(GL_TEXTURE_2D, atlas.pages[p].texture);
+		glDrawArrays(GL_TRIANGLES, page_ranges[p].first, page_ranges[p].second);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	GL_ERRORS();
+}
+
+TextBatch::~TextBatch() {
+	flush();
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * Helper class that collects glyph quads (from a GlyphAtlas) and draws them
+ * all at once with color_texture_program (or color_texture_sdf_program, for
+ * DistanceField atlases) -- one buffer upload and one draw call per atlas
+ * page, instead of one of each per glyph.
+ *
+ * Similar usage pattern to DrawLines:
+ *   {
+ *     TextBatch batch(atlas, drawable_size);
+ *     batch.draw_glyph(...); //many times
+ *   } //<-- quads are drawn when batch goes out of scope (or on flush())
+ *
+ */
+
+#include "GlyphAtlas.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct TextBatch {
+	//attribs are in the format expected by color_texture_program's 'vertex' input:
+	struct Vertex {
+		Vertex(glm::vec2 const &Position_, glm::vec2 const &TexCoord_) : Position(Position_), TexCoord(TexCoord_) { }
+		glm::vec2 Position;
+		glm::vec2 TexCoord; //in texels until flush() (atlas pages may grow while collecting)
+	};
+	static_assert(sizeof(Vertex) == 4*2 + 4*2, "TextBatch::Vertex is packed.");
+
+	//Start collecting; positions are in pixels with (0,0) at the lower left of the drawable:
+	TextBatch(GlyphAtlas const &atlas, glm::uvec2 const &drawable_size);
+
+	//add a glyph with its baseline origin at 'pen' (in pixels), scaled by 'scale':
+	void draw_glyph(GlyphAtlas::Glyph const &glyph, glm::vec2 const &pen, float scale);
+
+	//add already laid-out quads (e.g., from a TextLayout) for glyphs on atlas page 'page':
+	void draw_attribs(uint32_t page, std::vector< Vertex > const &attribs);
+
+	//text color used for glyphs drawn from now on:
+	// (changing the color flushes any glyphs already collected)
+	void set_color(glm::vec3 const &color);
+
+	//draw (and forget) everything collected so far:
+	void flush();
+
+	//Finish drawing (push attribs to GPU):
+	~TextBatch();
+
+	//helper: append the two triangles for a glyph to 'attribs' (used by draw_glyph and TextLayout):
+	static void append_glyph(std::vector< Vertex > *attribs, GlyphAtlas::Glyph const &glyph, glm::vec2 const &pen, float scale);
+
+	GlyphAtlas const &atlas;
+	glm::mat4 projection;
+	glm::vec3 color = glm::vec3(0.0f);
+
+	//vertices (two triangles per glyph) bucketed by atlas page:
+	std::vector< std::vector< Vertex > > page_attribs;
+};
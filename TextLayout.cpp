@@ -0,0 +1,122 @@
+#include "TextLayout.hpp"
+
+#include <algorithm>
+
+void TextLayout::set_text(std::string const &text_) {
+	if (text_ == text) return;
+	text = text_;
+	dirty = true;
+}
+
+void TextLayout::set_position(glm::vec2 const &position_) {
+	if (position_ == position) return;
+	position = position_;
+	dirty = true;
+}
+
+void TextLayout::set_scale(float scale_) {
+	if (scale_ == scale) return;
+	scale = scale_;
+	dirty = true;
+}
+
+void TextLayout::set_color(glm::vec3 const &color_) {
+	//color is applied when drawing, so changing it doesn't require a new layout:
+	color = color_;
+}
+
+void TextLayout::draw(TextBatch &batch, GlyphAtlas &atlas, ShapeCache &shape_cache, glm::uvec2 const &drawable_size) {
+	if (drawable_size != laid_out_drawable_size) dirty = true;
+
+	//if a page the layout refers to was evicted, its glyphs need to be re-rasterized:
+	for (auto const &pa : pages) {
+		if (pa.page >= atlas.pages.size() || atlas.pages[pa.page].evictions != pa.evictions) dirty = true;
+	}
+
+	if (dirty) {
+		layout(atlas, shape_cache, drawable_size);
+		laid_out_drawable_size = drawable_size;
+		dirty = false;
+	}
+
+	batch.set_color(color);
+	for (auto const &pa : pages) {
+		//keep the page from being evicted while it is in use this frame:
+		atlas.touch(pa.page);
+		batch.draw_attribs(pa.page, pa.attribs);
+	}
+}
+
+void TextLayout::layout(GlyphAtlas &atlas, ShapeCache &shape_cache, glm::uvec2 const &drawable_size) {
+	for (auto &pa : pages) {
+		pa.attribs.clear();
+	}
+
+	glm::vec2 pen = position;
+	std::string line;
+	for (auto ch : text) {
+		if (ch == '\n') {
+			if (line.size() > 0) {
+				float enter = layout_line(line, &pen, atlas, shape_cache, drawable_size);
+				pen.y -= enter;
+			}
+			line.clear();
+		} else {
+			line.push_back(ch);
+		}
+	}
+	if (line.size() > 0) {
+		layout_line(line, &pen, atlas, shape_cache, drawable_size);
+	}
+
+	//drop pages that are no longer used and remember the eviction count of those that are:
+	pages.erase(std::remove_if(pages.begin(), pages.end(), [](PageAttribs const &pa) {
+		return pa.attribs.empty();
+	}), pages.end());
+	for (auto &pa : pages) {
+		pa.evictions = atlas.pages[pa.page].evictions;
+	}
+}
+
+// SOURCE for most of layout_line function: https://learnopengl.com/In-Practice/Text-Rendering
+float TextLayout::layout_line(std::string const &line, glm::vec2 *pen_, GlyphAtlas &atlas, ShapeCache &shape_cache, glm::uvec2 const &drawable_size) {
+	assert(pen_);
+	glm::vec2 &pen = *pen_;
+
+	ShapeCache::Run const &run = shape_cache.shape(line, atlas.face, atlas.pixel_size);
+
+	float x = pen.x;
+	float y = pen.y;
+	float biggest_char_size = 0.0f;
+
+	for (auto const &shaped : run.glyphs) {
+		GlyphAtlas::Glyph glyph = atlas.lookup(shaped.index);
+
+		biggest_char_size = std::max(biggest_char_size, float(glyph.size.y));
+
+		if (glyph.size.x > 0 && glyph.size.y > 0) {
+			auto pa = std::find_if(pages.begin(), pages.end(), [&glyph](PageAttribs const &pa) {
+				return pa.page == glyph.page;
+			});
+			if (pa == pages.end()) {
+				pages.emplace_back();
+				pages.back().page = glyph.page;
+				pa = pages.end() - 1;
+			}
+			TextBatch::append_glyph(&pa->attribs, glyph, glm::vec2(x + (shaped.x_offset >> 6) * scale, y + (shaped.y_offset >> 6) * scale), scale);
+		}
+
+		//advance is in 1/64ths of a pixel:
+		x += (shaped.x_advance >> 6) * scale;
+		y += (shaped.y_advance >> 6) * scale;
+
+		//wrap near the right edge:
+		if (x >= float(drawable_size.x) - 50.0f) {
+			x = pen.x;
+			y -= biggest_char_size * 2.0f * scale;
+		}
+	}
+
+	pen.y = y;
+	return biggest_char_size * 2.0f * scale;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * A TextLayout is a retained paragraph of text: it remembers the positioned
+ * glyph quads for its text and only re-shapes / re-positions them when the
+ * text, position, scale, or drawable size changes (or when the glyph atlas
+ * page it uses has been evicted).
+ *
+ * Usage:
+ *   TextLayout layout; //e.g., as a member of a Mode
+ *   //each frame:
+ *   layout.set_text(text); //cheap if text is unchanged
+ *   layout.set_position(glm::vec2(x, y));
+ *   layout.set_scale(scale);
+ *   layout.draw(batch, atlas, shape_cache, drawable_size);
+ *
+ * Layout rules: lines are split at '\n'; each line is wrapped when it gets
+ * within 50 pixels of the right edge of the drawable; line spacing is twice
+ * the height of the line's tallest glyph.
+ *
+ */
+
+#include "GlyphAtlas.hpp"
+#include "ShapeCache.hpp"
+#include "TextBatch.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+struct TextLayout {
+	//these mark the layout as dirty only if the value actually changes:
+	void set_text(std::string const &text);
+	void set_position(glm::vec2 const &position); //baseline start of the first line (pixels)
+	void set_scale(float scale);
+	void set_color(glm::vec3 const &color);
+
+	//lay out text (if needed) and add its quads to 'batch':
+	void draw(TextBatch &batch, GlyphAtlas &atlas, ShapeCache &shape_cache, glm::uvec2 const &drawable_size);
+
+	//-- internals --
+
+	std::string text;
+	glm::vec2 position = glm::vec2(0.0f);
+	float scale = 1.0f;
+	glm::vec3 color = glm::vec3(0.0f);
+
+	bool dirty = true;
+	glm::uvec2 laid_out_drawable_size = glm::uvec2(0);
+
+	//laid-out quads, bucketed by atlas page, along with the page's eviction count at layout time:
+	struct PageAttribs {
+		uint32_t page = 0;
+		uint32_t evictions = 0;
+		std::vector< TextBatch::Vertex > attribs;
+	};
+	std::vector< PageAttribs > pages;
+
+	void layout(GlyphAtlas &atlas, ShapeCache &shape_cache, glm::uvec2 const &drawable_size);
+	float layout_line(std::string const &line, glm::vec2 *pen, GlyphAtlas &atlas, ShapeCache &shape_cache, glm::uvec2 const &drawable_size);
+};
@@ -0,0 +1,108 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+uint32_t ThreadPool::default_workers() {
+	uint32_t hardware = std::thread::hardware_concurrency(); //(may be 0 if unknown)
+	return (hardware > 1 ? hardware - 1 : 0);
+}
+
+ThreadPool::ThreadPool(uint32_t workers) {
+	for (uint32_t q = 0; q < 1 + workers; ++q) {
+		queues.emplace_back(std::make_unique< Queue >());
+	}
+	for (uint32_t w = 0; w < workers; ++w) {
+		threads.emplace_back(&ThreadPool::work, this, 1 + w);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		quit = true;
+	}
+	cv.notify_all();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+void ThreadPool::parallel_for(uint32_t count, uint32_t grain, std::function< void(uint32_t, uint32_t) > const &task) {
+	if (count == 0) return;
+	grain = std::max(1U, grain);
+	if (count <= grain || threads.empty()) {
+		//not worth waking anyone up:
+		task(0, count);
+		return;
+	}
+
+	//deal chunks out in contiguous runs, so each thread starts with neighboring data:
+	uint32_t chunks = (count + grain - 1) / grain;
+	assert(remaining.load() == 0);
+	remaining.store(chunks, std::memory_order_relaxed);
+	for (uint32_t q = 0; q < size(); ++q) {
+		uint32_t first = uint32_t(uint64_t(chunks) * q / size());
+		uint32_t last = uint32_t(uint64_t(chunks) * (q + 1) / size());
+		std::lock_guard< std::mutex > lock(queues[q]->mutex);
+		for (uint32_t c = first; c < last; ++c) {
+			queues[q]->chunks.emplace_back(Chunk{ c * grain, std::min(count, (c + 1) * grain), &task });
+		}
+	}
+
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		loops += 1;
+	}
+	cv.notify_all();
+
+	//help out, then wait for chunks other threads are still running:
+	while (run_one(0)) { }
+	while (remaining.load(std::memory_order_acquire) != 0) {
+		std::this_thread::yield();
+	}
+}
+
+bool ThreadPool::run_one(uint32_t index) {
+	Chunk chunk;
+	bool found = false;
+
+	//own queue first (front to back)...
+	{
+		Queue &queue = *queues[index];
+		std::lock_guard< std::mutex > lock(queue.mutex);
+		if (!queue.chunks.empty()) {
+			chunk = queue.chunks.front();
+			queue.chunks.pop_front();
+			found = true;
+		}
+	}
+	//...then steal from the back of the others:
+	for (uint32_t o = 1; o < size() && !found; ++o) {
+		Queue &queue = *queues[(index + o) % size()];
+		std::lock_guard< std::mutex > lock(queue.mutex);
+		if (!queue.chunks.empty()) {
+			chunk = queue.chunks.back();
+			queue.chunks.pop_back();
+			found = true;
+		}
+	}
+	if (!found) return false;
+
+	(*chunk.task)(chunk.begin, chunk.end);
+	remaining.fetch_sub(1, std::memory_order_acq_rel);
+	return true;
+}
+
+void ThreadPool::work(uint32_t index) {
+	uint64_t seen = 0;
+	for (;;) {
+		{ //wait for a new loop:
+			std::unique_lock< std::mutex > lock(mutex);
+			cv.wait(lock, [&]() { return quit || loops != seen; });
+			if (quit) break;
+			seen = loops;
+		}
+		while (run_one(index)) { }
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+/*
+ * A ThreadPool runs data-parallel loops on a fixed set of worker threads
+ * (plus the thread that asks for the loop):
+ *
+ *  - parallel_for() splits a range into chunks and deals them out, in
+ *    contiguous runs, to per-thread queues;
+ *  - each thread works through its own queue front-to-back, then steals
+ *    from the back of other threads' queues, so threads that finish early
+ *    (or started late) pick up the slack;
+ *  - parallel_for() returns once every chunk has run.
+ *
+ * Usage:
+ *   ThreadPool pool; //(one worker per extra hardware thread)
+ *   pool.parallel_for(count, 1024, [&](uint32_t begin, uint32_t end) {
+ *     for (uint32_t i = begin; i < end; ++i) { ... }
+ *   });
+ *
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+struct ThreadPool {
+	//start 'workers' worker threads (by default, one for each hardware thread but the caller's):
+	ThreadPool(uint32_t workers = default_workers());
+	~ThreadPool();
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+
+	//call task(begin, end) on chunks of at most 'grain' indices that together cover [0, count):
+	// (ranges no bigger than 'grain' just run on the calling thread)
+	//NOTE: only one thread at a time should call parallel_for on a given pool.
+	void parallel_for(uint32_t count, uint32_t grain, std::function< void(uint32_t, uint32_t) > const &task);
+
+	//threads that run chunks (workers plus the calling thread):
+	uint32_t size() const { return uint32_t(queues.size()); }
+
+	static uint32_t default_workers();
+
+	//internals:
+	struct Chunk {
+		uint32_t begin, end;
+		std::function< void(uint32_t, uint32_t) > const *task;
+	};
+	struct Queue {
+		std::mutex mutex;
+		std::deque< Chunk > chunks;
+	};
+	std::vector< std::unique_ptr< Queue > > queues; //queues[0] belongs to the calling thread, queues[1+w] to worker w
+	std::atomic< uint32_t > remaining = 0; //chunks of the current loop that haven't finished
+
+	std::vector< std::thread > threads;
+	std::mutex mutex; //wakes workers:
+	std::condition_variable cv;
+	uint64_t loops = 0; //loops started so far (protected by mutex)
+	bool quit = false; //(protected by mutex)
+
+	void work(uint32_t index); //worker thread main function
+	bool run_one(uint32_t index); //run a chunk from queue 'index' (or stolen from another); false if there were none
+};
@@ -0,0 +1,251 @@
+#include "TransformStore.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+
+TransformStore::Handle TransformStore::create(Handle parent, std::string const &name) {
+	uint32_t parent_index = (parent == Handle() ? -1U : index(parent));
+
+	//claim a slot for the handle:
+	Handle handle;
+	if (!free_slots.empty()) {
+		handle.slot = free_slots.back();
+		free_slots.pop_back();
+	} else {
+		handle.slot = uint32_t(slot_index.size());
+		slot_index.emplace_back(-1U);
+		slot_generation.emplace_back(0);
+	}
+	handle.generation = slot_generation[handle.slot];
+
+	//new transforms go at the end, which is always after their parent:
+	uint32_t i = size();
+	levels.clear();
+	positions.emplace_back(0.0f);
+	rotations.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+	scales.emplace_back(1.0f);
+	parents.emplace_back(parent_index);
+	world.emplace_back(1.0f);
+	names.emplace_back(name);
+	slots.emplace_back(handle.slot);
+	slot_index[handle.slot] = i;
+
+	return handle;
+}
+
+void TransformStore::destroy(Handle handle) {
+	std::vector< bool > doomed(size(), false);
+	mark_subtree(index(handle), &doomed);
+
+	//invalidate handles:
+	for (uint32_t i = 0; i < size(); ++i) {
+		if (!doomed[i]) continue;
+		slot_index[slots[i]] = -1U;
+		slot_generation[slots[i]] += 1;
+		free_slots.emplace_back(slots[i]);
+	}
+
+	doomed.flip();
+	partition(doomed, true);
+}
+
+bool TransformStore::valid(Handle handle) const {
+	return handle.slot < slot_index.size()
+		&& slot_generation[handle.slot] == handle.generation
+		&& slot_index[handle.slot] != -1U;
+}
+
+uint32_t TransformStore::index(Handle handle) const {
+	assert(valid(handle) && "handle refers to a destroyed transform");
+	return slot_index[handle.slot];
+}
+
+void TransformStore::set_parent(Handle handle, Handle new_parent) {
+	uint32_t i = index(handle);
+	levels.clear();
+	if (new_parent == Handle()) {
+		parents[i] = -1U;
+		return;
+	}
+	uint32_t p = index(new_parent);
+	if (p < i) {
+		//already in order:
+		parents[i] = p;
+		return;
+	}
+
+	std::vector< bool > moving(size(), false);
+	mark_subtree(i, &moving);
+	if (moving[p]) {
+		throw std::runtime_error("Can't parent transform '" + names[i] + "' to '" + names[p] + "', which is one of its descendants.");
+	}
+
+	//the new parent comes after the transform, so move the transform (and its descendants) to the end:
+	moving.flip();
+	partition(moving, false);
+	parents[index(handle)] = index(new_parent);
+}
+
+TransformStore::Handle TransformStore::get_parent(Handle handle) const {
+	uint32_t p = parents[index(handle)];
+	if (p == -1U) return Handle();
+	return Handle(slots[p], slot_generation[slots[p]]);
+}
+
+void TransformStore::update() {
+	update_range(0, size());
+}
+
+void TransformStore::update(ThreadPool &pool) {
+	if (levels.empty()) sort_by_depth();
+
+	//transforms in a level only depend on earlier levels, so each level can be split up freely:
+	for (uint32_t d = 0; d + 1 < levels.size(); ++d) {
+		uint32_t begin = levels[d];
+		pool.parallel_for(levels[d + 1] - begin, 2048, [this, begin](uint32_t b, uint32_t e) {
+			update_range(begin + b, begin + e);
+		});
+	}
+}
+
+void TransformStore::sort_by_depth() {
+	std::vector< uint32_t > depths(size());
+	uint32_t max_depth = 0;
+	for (uint32_t i = 0; i < size(); ++i) {
+		depths[i] = (parents[i] == -1U ? 0 : depths[parents[i]] + 1);
+		max_depth = std::max(max_depth, depths[i]);
+	}
+
+	//(stable) counting sort by depth:
+	std::vector< uint32_t > offsets(max_depth + 2, 0);
+	for (uint32_t i = 0; i < size(); ++i) {
+		offsets[depths[i] + 1] += 1;
+	}
+	for (uint32_t d = 1; d < offsets.size(); ++d) {
+		offsets[d] += offsets[d - 1];
+	}
+	std::vector< uint32_t > order(size());
+	std::vector< uint32_t > next(offsets.begin(), offsets.end() - 1);
+	for (uint32_t i = 0; i < size(); ++i) {
+		order[next[depths[i]]++] = i;
+	}
+	reorder(order);
+
+	levels = std::move(offsets);
+}
+
+void TransformStore::update_range(uint32_t begin, uint32_t end) {
+	assert(begin <= end && end <= size());
+	for (uint32_t i = begin; i < end; ++i) {
+		//local-to-parent (as in Scene::Transform::make_local_to_parent):
+		glm::mat3 rot = glm::mat3_cast(rotations[i]);
+		glm::vec3 x = rot[0] * scales[i].x;
+		glm::vec3 y = rot[1] * scales[i].y;
+		glm::vec3 z = rot[2] * scales[i].z;
+		glm::vec3 t = positions[i];
+
+		uint32_t p = parents[i];
+		if (p == -1U) {
+			world[i] = glm::mat4x3(x, y, z, t);
+		} else {
+			//parent's world matrix was already computed, since parents come first:
+			glm::mat4x3 const &pw = world[p];
+			world[i] = glm::mat4x3(
+				pw[0] * x.x + pw[1] * x.y + pw[2] * x.z,
+				pw[0] * y.x + pw[1] * y.y + pw[2] * y.z,
+				pw[0] * z.x + pw[1] * z.y + pw[2] * z.z,
+				pw[0] * t.x + pw[1] * t.y + pw[2] * t.z + pw[3]
+			);
+		}
+	}
+}
+
+void TransformStore::add(Scene const &scene, std::unordered_map< Scene::Transform const *, Handle > *transform_map_) {
+	std::unordered_map< Scene::Transform const *, Handle > t2h_temp;
+	std::unordered_map< Scene::Transform const *, Handle > &transform_to_handle = *(transform_map_ ? transform_map_ : &t2h_temp);
+	transform_to_handle.clear();
+
+	//scene transforms aren't necessarily listed parents-first, so add each transform's parent before it:
+	std::function< Handle(Scene::Transform const *) > add_transform = [&](Scene::Transform const *transform) -> Handle {
+		if (!transform) return Handle();
+		auto f = transform_to_handle.find(transform);
+		if (f != transform_to_handle.end()) return f->second;
+
+		Handle parent = add_transform(transform->parent);
+		Handle handle = create(parent, transform->name);
+		position(handle) = transform->position;
+		rotation(handle) = transform->rotation;
+		scale(handle) = transform->scale;
+		transform_to_handle.emplace(transform, handle);
+		return handle;
+	};
+
+	for (auto const &transform : scene.transforms) {
+		add_transform(&transform);
+	}
+}
+
+void TransformStore::mark_subtree(uint32_t i, std::vector< bool > *marks_) const {
+	assert(marks_);
+	auto &marks = *marks_;
+	assert(marks.size() == size());
+
+	//descendants all come after 'i', and after their own parents:
+	marks[i] = true;
+	for (uint32_t j = i + 1; j < size(); ++j) {
+		if (parents[j] != -1U && marks[parents[j]]) marks[j] = true;
+	}
+}
+
+void TransformStore::partition(std::vector< bool > const &keep, bool drop) {
+	assert(keep.size() == size());
+
+	std::vector< uint32_t > order;
+	order.reserve(size());
+	for (uint32_t i = 0; i < size(); ++i) {
+		if (keep[i]) order.emplace_back(i);
+	}
+	if (!drop) {
+		for (uint32_t i = 0; i < size(); ++i) {
+			if (!keep[i]) order.emplace_back(i);
+		}
+	}
+	reorder(order);
+}
+
+void TransformStore::reorder(std::vector< uint32_t > const &order) {
+	assert(order.size() <= size());
+	levels.clear();
+
+	std::vector< uint32_t > new_index(size(), -1U);
+	for (uint32_t n = 0; n < order.size(); ++n) {
+		new_index[order[n]] = n;
+	}
+
+	auto reorder = [&order](auto &array) {
+		typename std::remove_reference< decltype(array) >::type reordered;
+		reordered.reserve(order.size());
+		for (uint32_t i : order) {
+			reordered.emplace_back(std::move(array[i]));
+		}
+		array = std::move(reordered);
+	};
+	reorder(positions);
+	reorder(rotations);
+	reorder(scales);
+	reorder(parents);
+	reorder(world);
+	reorder(names);
+	reorder(slots);
+
+	for (uint32_t n = 0; n < size(); ++n) {
+		if (parents[n] != -1U) {
+			parents[n] = new_index[parents[n]];
+			assert(parents[n] < n && "transforms stay in topological order");
+		}
+		slot_index[slots[n]] = n;
+	}
+}
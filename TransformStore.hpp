@@ -0,0 +1,127 @@
+#pragma once
+
+/*
+ * A TransformStore holds a transform hierarchy as parallel arrays ("structure
+ * of arrays"), for hierarchies that are big or that change every frame:
+ *
+ *  - position, rotation, scale, parent index, and world matrix each live in
+ *    their own tightly-packed array;
+ *  - transforms are kept in topological order (parents before children, as
+ *    Scene::load requires of scene files), so update() computes every world
+ *    matrix in one front-to-back pass that streams through memory;
+ *  - gameplay code refers to transforms by Handle, which stays valid while
+ *    transforms are moved around in the arrays (by set_parent or destroy).
+ *
+ * Unlike Scene::Transform, nothing is recomputed on demand: world matrices
+ * are as of the last update().
+ *
+ * update(pool) does the same work across a ThreadPool's threads. To do so,
+ * it sorts the transforms by depth in the hierarchy (which is still parents
+ * first), so each level is a contiguous range whose transforms only depend
+ * on earlier levels. The sort happens again only after the hierarchy changes.
+ *
+ * Usage:
+ *   TransformStore store;
+ *   TransformStore::Handle body = store.create();
+ *   TransformStore::Handle arm = store.create(body);
+ *   store.position(arm) = glm::vec3(1.0f, 0.0f, 0.0f);
+ *   store.update();
+ *   glm::mat4x3 const &arm_to_world = store.local_to_world(arm);
+ *
+ */
+
+#include "Scene.hpp"
+#include "ThreadPool.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+struct TransformStore {
+	//Handles refer to transforms no matter where they are in the arrays:
+	struct Handle {
+		Handle() : slot(-1U), generation(0) { } //(a default Handle refers to no transform)
+		Handle(uint32_t slot_, uint32_t generation_) : slot(slot_), generation(generation_) { }
+		uint32_t slot; //index into the slot table
+		uint32_t generation; //slot's generation when the transform was created; slots are reused once this changes
+		bool operator==(Handle const &other) const { return slot == other.slot && generation == other.generation; }
+		bool operator!=(Handle const &other) const { return !(*this == other); }
+	};
+
+	//add a transform (as the last child of 'parent', or as a root if 'parent' is a default Handle):
+	Handle create(Handle parent = Handle(), std::string const &name = "");
+
+	//remove a transform along with all of its descendants:
+	void destroy(Handle handle);
+
+	//does 'handle' refer to a transform that hasn't been destroyed?
+	bool valid(Handle handle) const;
+
+	//move a transform (and its descendants) under a new parent (or to the root, for a default Handle):
+	// throws if 'new_parent' is the transform or one of its descendants
+	void set_parent(Handle handle, Handle new_parent);
+	Handle get_parent(Handle handle) const;
+
+	//local transformation, relative to the parent:
+	// (references are good until the next create, destroy, or set_parent --
+	//  or the next update(pool) after any of those, since it re-sorts the arrays)
+	glm::vec3 &position(Handle handle) { return positions[index(handle)]; }
+	glm::quat &rotation(Handle handle) { return rotations[index(handle)]; }
+	glm::vec3 &scale(Handle handle) { return scales[index(handle)]; }
+	std::string &name(Handle handle) { return names[index(handle)]; }
+
+	//world matrix, as of the last update():
+	glm::mat4x3 const &local_to_world(Handle handle) const { return world[index(handle)]; }
+
+	//recompute every world matrix (in one pass over the arrays):
+	void update();
+	//...or using all of a thread pool's threads:
+	// n.b. if the hierarchy changed since the last update(pool), this first re-sorts the arrays by depth,
+	// which moves transforms around (handles stay valid, but references from position() etc do not)
+	void update(ThreadPool &pool);
+
+	//copy all of a scene's transforms into the store:
+	// (returns the handle made for each transform, if 'transform_map' is given)
+	void add(Scene const &scene, std::unordered_map< Scene::Transform const *, Handle > *transform_map = nullptr);
+
+	//number of transforms in the store:
+	uint32_t size() const { return uint32_t(positions.size()); }
+
+	//internals:
+	//index of the transform in the arrays below (asserts that the handle is valid):
+	uint32_t index(Handle handle) const;
+
+	//transform data, in topological order -- parents[i] < i, or -1U for roots:
+	std::vector< glm::vec3 > positions;
+	std::vector< glm::quat > rotations;
+	std::vector< glm::vec3 > scales;
+	std::vector< uint32_t > parents;
+	std::vector< glm::mat4x3 > world;
+	std::vector< std::string > names; //(kept apart from the rest, since update() doesn't need it)
+
+	//handle book-keeping:
+	std::vector< uint32_t > slots; //slot of each transform (parallel to the arrays above)
+	std::vector< uint32_t > slot_index; //index of each slot's transform (-1U if the slot is free)
+	std::vector< uint32_t > slot_generation; //incremented when a slot's transform is destroyed
+	std::vector< uint32_t > free_slots;
+
+	//depth-sorted order for update(pool): transforms at depth d are [levels[d], levels[d+1])
+	// (empty if the hierarchy has changed since the last sort)
+	std::vector< uint32_t > levels;
+	void sort_by_depth();
+
+	//helper: compute world matrices for transforms [begin, end), whose parents' are already computed:
+	void update_range(uint32_t begin, uint32_t end);
+
+	//helper: move transform order[n] to index n (dropping any transforms not in 'order'):
+	void reorder(std::vector< uint32_t > const &order);
+	//helper: reorder the arrays so transforms with keep[i] come first (each group in its original order),
+	// then drop the rest if 'drop' is set:
+	void partition(std::vector< bool > const &keep, bool drop);
+	//helper: mark 'i' and its descendants in 'marks':
+	void mark_subtree(uint32_t i, std::vector< bool > *marks) const;
+};
@@ -0,0 +1,210 @@
+/*
+ * bench-mixer measures the audio mixer's throughput with Sound::render (no
+ * audio device needed) over a matrix of voice types:
+ *   2D (panned) or 3D (positioned) voices,
+ *   looping (a short sample that wraps often) or one-shot (a long sample),
+ *   static or ramping (new volume and pan/position targets every block).
+ *
+ * Results are in nanoseconds per voice-sample (lower is better), along with
+ * how many such voices fit in the real-time budget of one block
+ * (Sound::BlockSamples samples at 48kHz, i.e. ~21.3ms).
+ *
+ * Usage:
+ *   dist/bench-mixer [--voices N] [--blocks B] [--real R] [--pitch P] [--sinc] [--reverb S]
+ *
+ *   --voices N  voices playing in each case (default 256, at most Sound::MaxVoices)
+ *   --blocks B  blocks mixed per case (default 400)
+ *   --real R    real-voice budget (default: N, so every voice is mixed)
+ *   --pitch P   pitch of every voice (default 1, which needs no resampling)
+ *   --sinc      resample with Interpolation::Sinc instead of Interpolation::Linear
+ *   --reverb S  time the reverb with an S-second impulse response, then send every voice to it
+ *               (so the per-voice results below also include the reverb's per-block cost)
+ *
+ */
+
+#include "Sound.hpp"
+#include "Convolver.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct Case {
+	bool is_3D = false;
+	bool loop = false;
+	bool ramps = false;
+	float pitch = 1.0f;
+	Sound::Interpolation interpolation = Sound::Interpolation::Linear;
+	float reverb_send = 0.0f;
+};
+
+//mix 'blocks' blocks with 'voices' voices playing; returns nanoseconds per voice-sample:
+static double run(Case const &c, Sound::Sample const &short_sample, Sound::Sample const &long_sample, uint32_t voices, uint32_t blocks) {
+	std::vector< float > buffer(2 * 2 * Sound::BlockSamples); //(two blocks)
+	Sound::Sample const &sample = (c.loop ? short_sample : long_sample);
+
+	//voices spread around the listener (3D) or across the stereo field (2D):
+	auto pan = [&](uint32_t v, uint32_t block) {
+		return std::sin(0.37f * float(v) + 0.05f * float(block));
+	};
+	auto position = [&](uint32_t v, uint32_t block) {
+		float ang = 0.37f * float(v) + 0.05f * float(block);
+		float dist = 1.0f + float(v % 10);
+		return glm::vec3(dist * std::cos(ang), dist * std::sin(ang), 0.0f);
+	};
+	float volume = 1.0f / float(voices);
+
+	std::vector< Sound::PlayingSample > playing;
+	playing.reserve(voices);
+	for (uint32_t v = 0; v < voices; ++v) {
+		if (c.is_3D) {
+			if (c.loop) playing.emplace_back(Sound::loop_3D(sample, volume, position(v, 0), 5.0f));
+			else playing.emplace_back(Sound::play_3D(sample, volume, position(v, 0), 5.0f));
+		} else {
+			if (c.loop) playing.emplace_back(Sound::loop(sample, volume, pan(v, 0)));
+			else playing.emplace_back(Sound::play(sample, volume, pan(v, 0)));
+		}
+		playing.back().set_pitch(c.pitch, 0.0f);
+		playing.back().set_interpolation(c.interpolation);
+		playing.back().set_reverb_send(c.reverb_send, 0.0f);
+	}
+
+	//one block to warm up:
+	Sound::render(buffer.data(), 1);
+
+	auto before = std::chrono::high_resolution_clock::now();
+	for (uint32_t b = 0; b < blocks; ++b) {
+		if (c.ramps) {
+			float ramp = 2.0f * float(Sound::BlockSamples) / 48000.0f;
+			for (uint32_t v = 0; v < voices; ++v) {
+				playing[v].set_volume(volume * (0.75f + 0.25f * std::sin(0.1f * float(b + v))), ramp);
+				if (c.is_3D) playing[v].set_position(position(v, b + 1), ramp);
+				else playing[v].set_pan(pan(v, b + 1), ramp);
+			}
+		}
+		Sound::render(buffer.data(), 1);
+	}
+	auto after = std::chrono::high_resolution_clock::now();
+
+	for (auto const &p : playing) {
+		if (p.stopped()) throw std::runtime_error("A voice stopped during the benchmark.");
+	}
+
+	//clear out the voices before the next case:
+	Sound::stop_all_samples();
+	Sound::render(buffer.data(), 2);
+
+	double ns = std::chrono::duration< double, std::nano >(after - before).count();
+	return ns / (double(blocks) * double(voices) * double(Sound::BlockSamples));
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+	uint32_t voices = 256;
+	uint32_t blocks = 400;
+	uint32_t real = 0; //0 means "same as voices"
+	float pitch = 1.0f;
+	Sound::Interpolation interpolation = Sound::Interpolation::Linear;
+	float reverb = -1.0f; //impulse response length in seconds (negative means no reverb)
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--voices" && i + 1 < argc) {
+			voices = uint32_t(std::max(1, std::stoi(argv[++i])));
+		} else if (arg == "--blocks" && i + 1 < argc) {
+			blocks = uint32_t(std::max(1, std::stoi(argv[++i])));
+		} else if (arg == "--real" && i + 1 < argc) {
+			real = uint32_t(std::max(1, std::stoi(argv[++i])));
+		} else if (arg == "--pitch" && i + 1 < argc) {
+			pitch = std::max(0.0f, std::stof(argv[++i]));
+		} else if (arg == "--sinc") {
+			interpolation = Sound::Interpolation::Sinc;
+		} else if (arg == "--reverb" && i + 1 < argc) {
+			reverb = std::max(0.0f, std::stof(argv[++i]));
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--voices N] [--blocks B] [--real R] [--pitch P] [--sinc] [--reverb S]" << std::endl;
+			return 1;
+		}
+	}
+	if (voices > Sound::MaxVoices) {
+		throw std::runtime_error("Can't play more than " + std::to_string(Sound::MaxVoices) + " voices.");
+	}
+	if (real == 0) real = voices;
+	Sound::set_max_real_voices(real);
+
+	//looping voices wrap every 0.1 seconds; one-shot voices last the whole case:
+	std::vector< float > data(size_t(std::ceil(std::max(1.0f, pitch) * float((blocks + 2) * Sound::BlockSamples))));
+	for (uint32_t i = 0; i < data.size(); ++i) {
+		data[i] = std::sin(0.05f * float(i)) * 0.5f;
+	}
+	Sound::Sample long_sample(data);
+	data.resize(4800);
+	Sound::Sample short_sample(data);
+
+	double budget_ns = 1e9 * double(Sound::BlockSamples) / 48000.0;
+	std::printf("%u voices (%u real), pitch %g (%s), %u blocks per case; real-time budget is %.1fms per block.\n", voices, real, pitch, (interpolation == Sound::Interpolation::Sinc ? "sinc" : "linear"), blocks, budget_ns * 1e-6);
+
+	if (reverb >= 0.0f) {
+		//decaying noise (60dB down by the end) stands in for a recorded impulse response:
+		std::vector< float > response(size_t(reverb * 48000.0f));
+		uint32_t seed = 1;
+		for (uint32_t i = 0; i < response.size(); ++i) {
+			seed = seed * 1664525U + 1013904223U;
+			float noise = float(seed >> 8) / float(1 << 24) - 0.5f;
+			response[i] = noise * std::pow(0.001f, float(i) / float(response.size()));
+		}
+		Sound::set_reverb(Sound::Sample(response));
+
+		//time the reverb on its own, by running a Convolver like the mixer's on (non-silent) noise:
+		// (n.b. not through Sound::render with a quiet voice -- a silent voice is virtual, so it never
+		//  feeds the reverb, and the reverb skips its work once its input has been silent for a while)
+		Convolver convolver(response);
+		std::vector< float > input(2 * Convolver::BlockSize);
+		for (uint32_t i = 0; i < input.size(); ++i) {
+			seed = seed * 1664525U + 1013904223U;
+			input[i] = float(seed >> 8) / float(1 << 24) - 0.5f;
+		}
+		std::vector< float > output(2 * Convolver::BlockSize, 0.0f);
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t b = 0; b < blocks; ++b) {
+			convolver.process(input.data(), output.data());
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		double ns = std::chrono::duration< double, std::nano >(after - before).count() / double(blocks);
+		std::printf("reverb with a %gs impulse response: %.3fms per block (%.1f%% of budget)\n", reverb, ns * 1e-6, 100.0 * ns / budget_ns);
+	}
+
+	std::printf("%-22s %16s %18s\n", "case", "ns/voice-sample", "voices in budget");
+	for (uint32_t i = 0; i < 8; ++i) {
+		Case c;
+		c.is_3D = (i & 4) != 0;
+		c.loop = (i & 2) != 0;
+		c.ramps = (i & 1) != 0;
+		c.pitch = pitch;
+		c.interpolation = interpolation;
+		c.reverb_send = (reverb >= 0.0f ? 0.25f : 0.0f);
+		double ns = run(c, short_sample, long_sample, voices, blocks);
+		std::string name = std::string(c.is_3D ? "3D" : "2D") + (c.loop ? " loop" : " one-shot") + (c.ramps ? " ramps" : " static");
+		std::printf("%-22s %16.3f %18.0f\n", name.c_str(), ns, budget_ns / (ns * double(Sound::BlockSamples)));
+	}
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
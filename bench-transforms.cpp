@@ -0,0 +1,173 @@
+/*
+ * bench-transforms measures how long it takes to bring every world matrix of
+ * a transform hierarchy up to date after everything has moved (i.e., one
+ * frame's worth of hierarchy update), three ways:
+ *   scene:      Scene::Transform -- set_position on every root, then
+ *               make_local_to_world() on every transform (serial)
+ *   store:      TransformStore::update() -- one serial pass over parallel arrays
+ *   store xT:   TransformStore::update(pool) with a T-thread ThreadPool
+ *
+ * Hierarchies are forests of 64-transform "skeletons" (each bone parented to a
+ * random earlier bone of the same skeleton), at sizes from 10k transforms up
+ * to --max. Results are milliseconds per update (lower is better), and the
+ * speedup of the fastest parallel update over the scene path.
+ *
+ * Usage:
+ *   dist/bench-transforms [--max N] [--repeats R] [--threads T]
+ *
+ *   --max N      largest hierarchy, in transforms (default 1000000)
+ *   --repeats R  updates timed per case (default 20)
+ *   --threads T  largest thread pool to try (default: the number of hardware threads)
+ *
+ */
+
+#include "Scene.hpp"
+#include "TransformStore.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//time 'count' calls of 'fn' in milliseconds per call:
+template< typename F >
+static double time_ms(uint32_t count, F const &fn) {
+	fn(); //(warm up)
+	auto before = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; ++i) {
+		fn();
+	}
+	auto after = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration< double, std::milli >(after - before).count() / double(count);
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+	uint32_t max_transforms = 1000000;
+	uint32_t repeats = 20;
+	uint32_t max_threads = std::max(1U, ThreadPool::default_workers() + 1);
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--max" && i + 1 < argc) {
+			max_transforms = uint32_t(std::max(64, std::stoi(argv[++i])));
+		} else if (arg == "--repeats" && i + 1 < argc) {
+			repeats = uint32_t(std::max(1, std::stoi(argv[++i])));
+		} else if (arg == "--threads" && i + 1 < argc) {
+			max_threads = uint32_t(std::max(1, std::stoi(argv[++i])));
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--max N] [--repeats R] [--threads T]" << std::endl;
+			return 1;
+		}
+	}
+
+	//pools of 2, 4, 8, ... threads, up to max_threads:
+	std::vector< std::unique_ptr< ThreadPool > > pools;
+	for (uint32_t threads = 2; threads < max_threads; threads *= 2) {
+		pools.emplace_back(std::make_unique< ThreadPool >(threads - 1));
+	}
+	if (max_threads > 1) pools.emplace_back(std::make_unique< ThreadPool >(max_threads - 1));
+
+	std::printf("%u hardware threads; %u updates per case.\n", ThreadPool::default_workers() + 1, repeats);
+	std::printf("%10s %10s %10s", "transforms", "scene", "store");
+	for (auto const &pool : pools) {
+		std::printf(" %10s", ("store x" + std::to_string(pool->size())).c_str());
+	}
+	std::printf(" %10s\n", "speedup");
+
+	for (uint32_t count = 10000; ; count *= 10) {
+		count = std::min(count, max_transforms);
+		uint32_t skeletons = std::max(1U, count / 64);
+
+		//build the hierarchy as a Scene:
+		std::mt19937 mt(0x15466);
+		auto random = [&mt]() {
+			return std::uniform_real_distribution< float >(-1.0f, 1.0f)(mt);
+		};
+		Scene scene;
+		std::vector< Scene::Transform * > roots;
+		std::vector< Scene::Transform * > bones;
+		for (uint32_t s = 0; s < skeletons; ++s) {
+			bones.clear();
+			for (uint32_t b = 0; b < 64; ++b) {
+				scene.transforms.emplace_back();
+				Scene::Transform *transform = &scene.transforms.back();
+				if (b == 0) {
+					roots.emplace_back(transform);
+				} else {
+					transform->set_parent(bones[std::uniform_int_distribution< uint32_t >(0, b - 1)(mt)]);
+				}
+				transform->set_position(glm::vec3(random(), random(), random()));
+				transform->set_rotation(glm::normalize(glm::quat(1.0f, 0.1f * random(), 0.1f * random(), 0.1f * random())));
+				bones.emplace_back(transform);
+			}
+		}
+
+		//...and as a TransformStore:
+		TransformStore store;
+		std::unordered_map< Scene::Transform const *, TransformStore::Handle > handles;
+		store.add(scene, &handles);
+
+		//make sure a store update got the same answer as the scene path:
+		auto check = [&](std::string const &what) {
+			for (auto const &transform : scene.transforms) {
+				glm::mat4x3 const &a = transform.local_to_world;
+				glm::mat4x3 const &b = store.local_to_world(handles.at(&transform));
+				for (uint32_t c = 0; c < 4; ++c) {
+					if (glm::length(a[c] - b[c]) > 1e-3f * (1.0f + glm::length(a[c]))) {
+						throw std::runtime_error("Scene and " + what + " world matrices differ.");
+					}
+				}
+			}
+		};
+
+		double scene_ms = time_ms(repeats, [&]() {
+			for (Scene::Transform *root : roots) {
+				root->set_position(root->position);
+			}
+			for (auto const &transform : scene.transforms) {
+				transform.make_local_to_world();
+			}
+		});
+		double store_ms = time_ms(repeats, [&]() {
+			store.update();
+		});
+		check("TransformStore");
+		std::printf("%10u %10.3f %10.3f", skeletons * 64, scene_ms, store_ms);
+
+		double best_ms = store_ms;
+		for (auto const &pool : pools) {
+			double pool_ms = time_ms(repeats, [&]() {
+				store.update(*pool);
+			});
+			check("TransformStore (" + std::to_string(pool->size()) + " threads)");
+			best_ms = std::min(best_ms, pool_ms);
+			std::printf(" %10.3f", pool_ms);
+		}
+		std::printf(" %9.1fx\n", scene_ms / best_ms);
+
+		if (count == max_transforms) break;
+	}
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -0,0 +1,169 @@
+/*
+ * compile-story turns the game's text story files into the binary blob
+ * loaded by Story (see Story.hpp).
+ *
+ * Usage (from the root of the repository):
+ *   dist/compile-story dist/dialogue.txt dist/choice.txt dist/effect.txt dist/story.bin
+ *
+ * Text file formats (every entry ends with an empty line):
+ *   dialogue.txt: id, then text lines
+ *   choice.txt: id, then for each of the two options [probability of first effect, first effect id, second effect id, option text], then text lines
+ *   effect.txt: id, academics change, social change, health change, then text lines
+ *
+ */
+
+#include "Story.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+//helper: open a text file or throw:
+static std::ifstream open(std::string const &filename) {
+	std::ifstream file(filename);
+	if (!file) throw std::runtime_error("Failed to open '" + filename + "'.");
+	return file;
+}
+
+//helper: append 'text' to the story's string table, returning its range:
+static void add_text(Story *story, std::string const &text, uint32_t *begin, uint32_t *end) {
+	*begin = uint32_t(story->texts.size());
+	story->texts.insert(story->texts.end(), text.begin(), text.end());
+	*end = uint32_t(story->texts.size());
+}
+
+//helper: read text lines up to (and including) an empty line:
+// (the empty line is kept as a trailing newline, as the game has always drawn it)
+static std::string read_text(std::ifstream &file) {
+	std::string text;
+	std::string line = ".";
+	while (line != "") {
+		//(getline clears 'line' at end-of-file, so a missing final empty line is fine)
+		std::getline(file, line);
+		text.append(line + "\n");
+	}
+	return text;
+}
+
+//helper: read a line that must be a number:
+template< typename T >
+static T read_number(std::ifstream &file, std::string const &what) {
+	std::string line;
+	if (!std::getline(file, line)) throw std::runtime_error("Unexpected end of file reading " + what + ".");
+	try {
+		if constexpr (std::is_floating_point< T >::value) return T(std::stof(line));
+		else return T(std::stoi(line));
+	} catch (std::exception &) {
+		throw std::runtime_error("Expected " + what + ", got '" + line + "'.");
+	}
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+	if (argc != 5) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <dialogue.txt> <choice.txt> <effect.txt> <story.bin>" << std::endl;
+		return 1;
+	}
+
+	Story story;
+
+	//every id may be used by only one node:
+	std::unordered_map< uint32_t, std::string > id_owner;
+	auto add_node = [&](std::string const &id_line, Story::Node::Type type, std::string const &where) -> Story::Node & {
+		uint32_t id = uint32_t(std::stoi(id_line));
+		auto ret = id_owner.emplace(id, where);
+		if (!ret.second) {
+			throw std::runtime_error("Id " + std::to_string(id) + " used in both " + ret.first->second + " and " + where + ".");
+		}
+		if (id >= 0x10000) {
+			//(ids index a table, so they should be small)
+			throw std::runtime_error("Id " + std::to_string(id) + " in " + where + " is too large.");
+		}
+		if (story.nodes.size() <= id) story.nodes.resize(id + 1);
+		story.nodes[id].type = type;
+		return story.nodes[id];
+	};
+
+	{ //dialogue:
+		std::ifstream file = open(argv[1]);
+		std::string id_line;
+		while (std::getline(file, id_line)) {
+			Story::Node &dialogue = add_node(id_line, Story::Node::Dialogue, argv[1]);
+			add_text(&story, read_text(file), &dialogue.text_begin, &dialogue.text_end);
+		}
+	}
+
+	{ //choices:
+		std::ifstream file = open(argv[2]);
+		auto read_option = [&](Story::Option *option) {
+			option->prob = read_number< float >(file, "probability");
+			option->effect1_id = read_number< uint32_t >(file, "effect id");
+			option->effect2_id = read_number< uint32_t >(file, "effect id");
+			//option text is a single line:
+			std::string line;
+			std::getline(file, line);
+			add_text(&story, line, &option->text_begin, &option->text_end);
+		};
+
+		std::string id_line;
+		while (std::getline(file, id_line)) {
+			Story::Node &choice = add_node(id_line, Story::Node::Choice, argv[2]);
+			read_option(&choice.options[0]);
+			read_option(&choice.options[1]);
+			add_text(&story, read_text(file), &choice.text_begin, &choice.text_end);
+		}
+	}
+
+	{ //effects:
+		std::ifstream file = open(argv[3]);
+		std::string id_line;
+		while (std::getline(file, id_line)) {
+			Story::Node &effect = add_node(id_line, Story::Node::Effect, argv[3]);
+			effect.academics = read_number< int32_t >(file, "academics change");
+			effect.social = read_number< int32_t >(file, "social change");
+			effect.health = read_number< int32_t >(file, "health change");
+			add_text(&story, read_text(file), &effect.text_begin, &effect.text_end);
+		}
+	}
+
+	//choices should lead to effects that exist:
+	for (uint32_t id = 0; id < story.nodes.size(); ++id) {
+		Story::Node const &choice = story.nodes[id];
+		if (choice.type != Story::Node::Choice) continue;
+		for (auto const &option : choice.options) {
+			for (uint32_t effect_id : {option.effect1_id, option.effect2_id}) {
+				if (story.node(effect_id).type != Story::Node::Effect) {
+					std::cerr << "WARNING: choice " << id << " refers to effect " << effect_id << ", which isn't in " << argv[3] << "." << std::endl;
+				}
+			}
+			if (!(option.prob >= 0.0f && option.prob <= 1.0f)) {
+				std::cerr << "WARNING: choice " << id << " has probability " << option.prob << ", outside [0,1]." << std::endl;
+			}
+		}
+	}
+
+	story.save(argv[4]);
+
+	//PARANOIA: make sure the result loads:
+	Story check(argv[4]);
+
+	std::cout << "Wrote " << id_owner.size() << " nodes (ids 0-" << story.nodes.size() - 1 << ") and " << story.texts.size() << " bytes of text to '" << argv[4] << "'." << std::endl;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -2,8 +2,8 @@
 
 #include <opusfile.h>
 
+#include <algorithm>
 #include <cassert>
-#include <memory>
 #include <cmath>
 #include <stdexcept>
 #include <iostream>
@@ -15,18 +15,10 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 
 	std::cout << "loading '" << filename << "'..."; std::cout.flush();
 
-	//will hold opusfile * int a std::unique_ptr so that it will automatically be deleted:
-	int err = 0;
-	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
-		op_open_file(filename.c_str(), &err), //pointer to hold
-		op_free //deletion function
-	);
-	if (err != 0) {
-		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
-	}
+	OpusReader reader(filename);
 
 	//get length in samples:
-	ogg_int64_t length = op_pcm_total(op.get(), -1);
+	int64_t length = reader.length();
 	if (length >= 0) {
 		data.reserve(length);
 	} else {
@@ -35,20 +27,51 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 		data.reserve(2*48000);
 	}
 
-	std::vector< float > pcm(2*48000*2, 0.0f); //seems like reads are generally 960 samples so this is definitely overkill
+	std::vector< float > chunk(2*48000, 0.0f);
 	for (;;) {
-		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
-		if (ret >= 0) {
-			//positive return values are the number of samples read per channel; copy into data:
-			data.reserve(data.size() + ret);
-			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
-				data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f); //downmix to mono by averaging
-			}
-			if (ret == 0) break;
-		} else {
-			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
-		}
+		uint32_t ret = reader.read(chunk.data(), uint32_t(chunk.size()));
+		if (ret == 0) break;
+		data.insert(data.end(), chunk.begin(), chunk.begin() + ret);
 	}
 
 	std::cout << " done." << std::endl;
 }
+
+OpusReader::OpusReader(std::string const &filename_) : filename(filename_) {
+	int err = 0;
+	file = op_open_file(filename.c_str(), &err);
+	if (err != 0) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+	}
+}
+
+OpusReader::~OpusReader() {
+	op_free(file);
+}
+
+uint32_t OpusReader::read(float *data, uint32_t count) {
+	assert(data);
+	//scratch space for the stereo samples grows to fit the largest read so far:
+	// (so a long-lived reader that reads a little at a time stays small)
+	if (pcm.size() < size_t(count) * 2) pcm.resize(size_t(count) * 2);
+	int ret = op_read_float_stereo(file, pcm.data(), int(size_t(count) * 2));
+	if (ret < 0) {
+		throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+	}
+	//positive return values are the number of samples read per channel; copy into data:
+	for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+		data[i] = (pcm[2*i] + pcm[2*i+1]) * 0.5f; //downmix to mono by averaging
+	}
+	return uint32_t(ret);
+}
+
+void OpusReader::rewind() {
+	int ret = op_pcm_seek(file, 0);
+	if (ret != 0) {
+		throw std::runtime_error("opusfile seek error " + std::to_string(ret) + " rewinding \"" + filename + "\".");
+	}
+}
+
+int64_t OpusReader::length() const {
+	return op_pcm_total(file, -1);
+}
@@ -1,7 +1,30 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
 //Load an opus file as 48kHz floating-point mono; throws on error:
 void load_opus(std::string const &filename, std::vector< float > *data);
+
+//Decode an opus file a piece at a time (e.g., for streaming playback) as 48kHz floating-point mono:
+struct OggOpusFile;
+struct OpusReader {
+	OpusReader(std::string const &filename); //throws on error
+	~OpusReader();
+	OpusReader(OpusReader const &) = delete;
+	OpusReader &operator=(OpusReader const &) = delete;
+
+	//decode up to 'count' samples into 'data'; returns the number decoded (0 at end of file); throws on error:
+	uint32_t read(float *data, uint32_t count);
+
+	//go back to the start of the file; throws on error:
+	void rewind();
+
+	//length in samples, or -1 if it can't be determined:
+	int64_t length() const;
+
+	std::string filename;
+	OggOpusFile *file = nullptr;
+	std::vector< float > pcm; //stereo samples, before downmixing (sized to the largest read)
+};
@@ -3,12 +3,14 @@
 #include <SDL.h>
 
 #include <iostream>
+#include <fstream>
 #include <cassert>
 #include <algorithm>
+#include <cstring>
 
 constexpr uint32_t AUDIO_RATE = 48000;
 
-void load_wav(std::string const &filename, std::vector< float > *data_) {
+void load_wav(std::string const &filename, std::vector< float > *data_, uint32_t *rate) {
 	assert(data_);
 	auto &data = *data_;
 
@@ -21,11 +23,14 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 		throw std::runtime_error("Failed to load WAV file '" + filename + "'; SDL says \"" + std::string(SDL_GetError()) + "\"");
 	}
 
+	uint32_t target_rate = (rate ? uint32_t(have->freq) : AUDIO_RATE);
+	if (rate) *rate = target_rate;
+
 	//based on the SDL_AudioCVT example in the docs: https://wiki.libsdl.org/SDL_AudioCVT
 	SDL_AudioCVT cvt;
-	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, AUDIO_RATE);
+	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, target_rate);
 	if (cvt.needed) {
-		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting." << std::endl;
+		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(target_rate) + " Hz, float32, mono; converting." << std::endl;
 		cvt.len = audio_len;
 		cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
 		SDL_memcpy(cvt.buf, audio_buf, audio_len);
@@ -48,3 +53,61 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	}
 	std::cout << "Range: " << min << ", " << max << std::endl;
 }
+
+void save_wav(std::string const &filename, std::vector< float > const &data, uint32_t channels) {
+	assert(channels > 0 && data.size() % channels == 0);
+
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) {
+		throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+	}
+
+	//WAV fields are little-endian:
+	auto write_u32 = [&out](uint32_t v) {
+		char bytes[4] = { char(v & 0xff), char((v >> 8) & 0xff), char((v >> 16) & 0xff), char((v >> 24) & 0xff) };
+		out.write(bytes, 4);
+	};
+	auto write_u16 = [&out](uint16_t v) {
+		char bytes[2] = { char(v & 0xff), char((v >> 8) & 0xff) };
+		out.write(bytes, 2);
+	};
+
+	uint32_t frames = uint32_t(data.size() / channels);
+	uint32_t data_bytes = uint32_t(data.size() * 4);
+
+	out.write("RIFF", 4);
+	write_u32(4 + (8 + 18) + (8 + 4) + (8 + data_bytes));
+	out.write("WAVE", 4);
+
+	out.write("fmt ", 4);
+	write_u32(18);
+	write_u16(3); //WAVE_FORMAT_IEEE_FLOAT
+	write_u16(uint16_t(channels));
+	write_u32(AUDIO_RATE);
+	write_u32(AUDIO_RATE * channels * 4); //bytes per second
+	write_u16(uint16_t(channels * 4)); //bytes per frame
+	write_u16(32); //bits per sample
+	write_u16(0); //no extension
+
+	//(non-PCM formats carry a 'fact' chunk with the length in frames)
+	out.write("fact", 4);
+	write_u32(4);
+	write_u32(frames);
+
+	out.write("data", 4);
+	write_u32(data_bytes);
+	std::vector< char > bytes(data_bytes);
+	for (size_t i = 0; i < data.size(); ++i) {
+		uint32_t v;
+		static_assert(sizeof(v) == sizeof(data[i]), "floats are 32 bits");
+		std::memcpy(&v, &data[i], sizeof(v));
+		for (uint32_t b = 0; b < 4; ++b) {
+			bytes[4 * i + b] = char((v >> (8 * b)) & 0xff);
+		}
+	}
+	out.write(bytes.data(), bytes.size());
+
+	if (!out) {
+		throw std::runtime_error("Failed to write WAV file '" + filename + "'.");
+	}
+}
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
 //Load a WAV file as 48kHz floating-point mono; throws on error:
-void load_wav(std::string const &filename, std::vector< float > *data);
+// (if 'rate' is supplied, the file's own sampling rate is kept instead, and stored there)
+void load_wav(std::string const &filename, std::vector< float > *data, uint32_t *rate = nullptr);
+
+//Save 48kHz floating-point audio as a WAV file ('channels' > 1 means samples are interleaved); throws on error:
+void save_wav(std::string const &filename, std::vector< float > const &data, uint32_t channels = 1);
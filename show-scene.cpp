@@ -121,6 +121,9 @@ int main(int argc, char **argv) {
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
 
+				drawable.min = mesh.min;
+				drawable.max = mesh.max;
+
 			});
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading scene '" << scene_file << "': " << e.what() << std::endl;
@@ -0,0 +1,257 @@
+/*
+ * simulate-story plays through the compiled story many times (following
+ * StoryRules, as PlayMode does) on all cores, and reports how often each
+ * ending is reached and where stats end up.
+ *
+ * Usage:
+ *   dist/simulate-story [--runs N] [--threads T] [--seed S] [--policy P] [story.bin]
+ *
+ * Policies say which option is picked at each choice:
+ *   first   - always the first option
+ *   second  - always the second option
+ *   random  - a coin flip at each choice
+ *   <mask>  - the second option at the i'th choice of the playthrough iff bit i of mask is set (e.g. 0x15)
+ *   all     - every mask, reporting the policies most likely to PASS
+ *
+ */
+
+#include "Story.hpp"
+#include "StoryRules.hpp"
+#include "data_path.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Policy {
+	enum Kind {
+		First,
+		Second,
+		Random,
+		Mask,
+	} kind = Random;
+	uint32_t mask = 0; //for Mask: bit i set means pick the second option at choice i
+
+	bool pick_second(uint32_t choice_index, std::mt19937 &rng) const {
+		if (kind == First) return false;
+		if (kind == Second) return true;
+		if (kind == Random) return (rng() & 1) != 0;
+		return ((mask >> choice_index) & 1) != 0;
+	}
+};
+
+//endings, in StoryLine order:
+static char const *OutcomeNames[4] = { "PASS", "FAIL_ACADEMICS", "FAIL_SOCIAL", "FAIL_HEALTH" };
+
+//final stats are binned as: <= 0, 1-10, 11-20, ..., 91-100:
+constexpr uint32_t StatBins = 11;
+static uint32_t stat_bin(int32_t stat) {
+	if (stat <= 0) return 0;
+	return uint32_t(std::min(stat, int32_t(StoryRules::MaxStat)) + 9) / 10;
+}
+
+struct Tally {
+	std::array< uint64_t, 4 > outcomes{};
+	std::array< std::array< uint64_t, StatBins >, 3 > histograms{}; //academics, social, health
+	std::array< double, 3 > stat_sums{};
+	uint64_t runs = 0;
+
+	void add(Tally const &other) {
+		for (uint32_t i = 0; i < 4; ++i) outcomes[i] += other.outcomes[i];
+		for (uint32_t s = 0; s < 3; ++s) {
+			for (uint32_t b = 0; b < StatBins; ++b) histograms[s][b] += other.histograms[s][b];
+			stat_sums[s] += other.stat_sums[s];
+		}
+		runs += other.runs;
+	}
+};
+
+//play one game from the start to an ending, returning the ending (index into OutcomeNames):
+static uint32_t play(Story const &story, Policy const &policy, std::mt19937 &rng, std::array< int32_t, 3 > *stats_) {
+	auto &stats = *stats_;
+	stats = { StoryRules::StartStat, StoryRules::StartStat, StoryRules::StartStat };
+
+	std::array< uint32_t, StoryRules::Events > story_line = StoryRules::StoryLine;
+	uint32_t current_event = 0;
+	uint32_t choice_index = 0;
+	std::uniform_real_distribution< float > uniform(0.0f, 1.0f);
+
+	//each iteration is one press of enter (see PlayMode::update):
+	while (true) {
+		if (current_event >= StoryRules::PassEvent) return current_event - StoryRules::PassEvent;
+
+		if (stats[0] <= 0) {
+			current_event = StoryRules::FailAcademicsEvent;
+		} else if (stats[1] <= 0) {
+			current_event = StoryRules::FailSocialEvent;
+		} else if (stats[2] <= 0) {
+			current_event = StoryRules::FailHealthEvent;
+		} else {
+			Story::Node const &state = story.node(story_line[current_event]);
+			if (state.type == Story::Node::Choice) {
+				Story::Option const &option = state.options[policy.pick_second(choice_index, rng) ? 1 : 0];
+				choice_index += 1;
+
+				uint32_t effect_id = (uniform(rng) < option.prob ? option.effect1_id : option.effect2_id);
+				Story::Node const &effect = story.node(effect_id);
+				stats[0] += effect.academics;
+				stats[1] += effect.social;
+				stats[2] += effect.health;
+				current_event += 1;
+				story_line[current_event] = (effect.type == Story::Node::Effect ? effect_id : 0);
+			} else {
+				current_event += 1;
+			}
+		}
+
+		//(PlayMode::draw clamps stats before they are next checked)
+		for (auto &stat : stats) stat = std::min(stat, int32_t(StoryRules::MaxStat));
+	}
+}
+
+//play 'runs' games spread over 'threads' threads:
+static Tally simulate(Story const &story, Policy const &policy, uint64_t runs, uint32_t threads, uint32_t seed) {
+	std::vector< Tally > tallies(threads);
+	std::vector< std::thread > workers;
+	workers.reserve(threads);
+	for (uint32_t t = 0; t < threads; ++t) {
+		uint64_t begin = runs * t / threads;
+		uint64_t end = runs * (t + 1) / threads;
+		workers.emplace_back([&story, &policy, &tally = tallies[t], begin, end, seed, t]() {
+			//every thread gets its own generator, so results only depend on the seed and thread count:
+			std::seed_seq seq{ seed, t };
+			std::mt19937 rng(seq);
+			std::array< int32_t, 3 > stats;
+			for (uint64_t r = begin; r < end; ++r) {
+				uint32_t outcome = play(story, policy, rng, &stats);
+				tally.outcomes[outcome] += 1;
+				for (uint32_t s = 0; s < 3; ++s) {
+					tally.histograms[s][stat_bin(stats[s])] += 1;
+					tally.stat_sums[s] += stats[s];
+				}
+				tally.runs += 1;
+			}
+		});
+	}
+	Tally total;
+	for (uint32_t t = 0; t < threads; ++t) {
+		workers[t].join();
+		total.add(tallies[t]);
+	}
+	return total;
+}
+
+static void report(Tally const &tally) {
+	std::printf("Endings (%llu runs):\n", (unsigned long long)tally.runs);
+	for (uint32_t i = 0; i < 4; ++i) {
+		std::printf("  %-15s %6.2f%%\n", OutcomeNames[i], 100.0 * double(tally.outcomes[i]) / double(tally.runs));
+	}
+
+	char const *stat_names[3] = { "academics", "social", "health" };
+	std::printf("Final stats:\n");
+	std::printf("  %-10s %7s", "", "mean");
+	std::printf(" %6s", "<=0");
+	for (uint32_t b = 1; b < StatBins; ++b) {
+		std::printf(" %6s", (std::to_string(b * 10 - 9) + "-" + std::to_string(b * 10)).c_str());
+	}
+	std::printf("\n");
+	for (uint32_t s = 0; s < 3; ++s) {
+		std::printf("  %-10s %7.2f", stat_names[s], tally.stat_sums[s] / double(tally.runs));
+		for (uint32_t b = 0; b < StatBins; ++b) {
+			std::printf(" %5.1f%%", 100.0 * double(tally.histograms[s][b]) / double(tally.runs));
+		}
+		std::printf("\n");
+	}
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+	uint64_t runs = 1000000;
+	uint32_t threads = std::max(1U, std::thread::hardware_concurrency());
+	uint32_t seed = 0x15466;
+	std::string policy_name = "random";
+	std::string story_path = data_path("story.bin");
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--runs" && i + 1 < argc) {
+			runs = std::stoull(argv[++i]);
+		} else if (arg == "--threads" && i + 1 < argc) {
+			threads = std::max(1, std::stoi(argv[++i]));
+		} else if (arg == "--seed" && i + 1 < argc) {
+			seed = uint32_t(std::stoul(argv[++i], nullptr, 0));
+		} else if (arg == "--policy" && i + 1 < argc) {
+			policy_name = argv[++i];
+		} else if (arg.size() > 0 && arg[0] != '-') {
+			story_path = arg;
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--runs N] [--threads T] [--seed S] [--policy first|second|random|<mask>|all] [story.bin]" << std::endl;
+			return 1;
+		}
+	}
+
+	Story story(story_path);
+
+	//count choices on the story line (for masks):
+	uint32_t choices = 0;
+	for (uint32_t id : StoryRules::StoryLine) {
+		if (story.node(id).type == Story::Node::Choice) choices += 1;
+	}
+
+	auto before = std::chrono::high_resolution_clock::now();
+
+	if (policy_name == "all") {
+		if (choices > 16) throw std::runtime_error("Too many choices (" + std::to_string(choices) + ") to try every policy.");
+		std::vector< std::pair< double, uint32_t > > pass_rates;
+		for (uint32_t mask = 0; mask < (1U << choices); ++mask) {
+			Policy policy;
+			policy.kind = Policy::Mask;
+			policy.mask = mask;
+			Tally tally = simulate(story, policy, runs, threads, seed);
+			pass_rates.emplace_back(double(tally.outcomes[0]) / double(tally.runs), mask);
+		}
+		std::sort(pass_rates.begin(), pass_rates.end(), std::greater< std::pair< double, uint32_t > >());
+		std::printf("Most likely to PASS (%llu runs per policy; bit i set = second option at choice i):\n", (unsigned long long)runs);
+		for (uint32_t i = 0; i < pass_rates.size() && i < 10; ++i) {
+			std::printf("  0x%04x %6.2f%%\n", pass_rates[i].second, 100.0 * pass_rates[i].first);
+		}
+		std::printf("  ...\n  0x%04x %6.2f%% (least likely)\n", pass_rates.back().second, 100.0 * pass_rates.back().first);
+		runs *= pass_rates.size();
+	} else {
+		Policy policy;
+		if (policy_name == "first") policy.kind = Policy::First;
+		else if (policy_name == "second") policy.kind = Policy::Second;
+		else if (policy_name == "random") policy.kind = Policy::Random;
+		else {
+			policy.kind = Policy::Mask;
+			policy.mask = uint32_t(std::stoul(policy_name, nullptr, 0));
+		}
+		report(simulate(story, policy, runs, threads, seed));
+	}
+
+	auto after = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration< double >(after - before).count();
+	std::printf("%llu playthroughs on %u threads in %.2f seconds (%.1f million per second).\n", (unsigned long long)runs, threads, seconds, double(runs) / seconds * 1e-6);
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
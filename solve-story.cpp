@@ -0,0 +1,287 @@
+/*
+ * solve-story computes the exact probability of each ending of the compiled
+ * story (following StoryRules, as PlayMode does), by propagating probability
+ * mass over (event, academics, social, health) states. Playthroughs that
+ * reach the same state are merged, so the work is bounded by the number of
+ * distinct states rather than the number of paths.
+ *
+ * It also finds the policy that makes passing most likely -- both the best
+ * fixed sequence of options and the best policy that looks at the stats.
+ *
+ * Usage:
+ *   dist/solve-story [--policy P] [--decisions] [story.bin]
+ *
+ * Policies (as in simulate-story):
+ *   first, second, random, <mask> - report exact ending probabilities for that policy
+ *   optimal (default)            - report the best stat-aware policy and the best fixed mask
+ * --decisions lists the optimal policy's pick for every reachable state at every choice.
+ *
+ */
+
+#include "Story.hpp"
+#include "StoryRules.hpp"
+#include "data_path.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//stats are packed into one key so states can be merged with a hash map:
+struct Stats {
+	int32_t academics, social, health;
+};
+constexpr int32_t StatOffset = 512; //stats must stay in [-StatOffset, 1024 - StatOffset)
+static uint32_t pack(Stats const &s) {
+	for (int32_t v : { s.academics, s.social, s.health }) {
+		if (v < -StatOffset || v >= 1024 - StatOffset) throw std::runtime_error("Stat " + std::to_string(v) + " is out of the solver's range.");
+	}
+	return (uint32_t(s.academics + StatOffset) << 20) | (uint32_t(s.social + StatOffset) << 10) | uint32_t(s.health + StatOffset);
+}
+static Stats unpack(uint32_t key) {
+	return Stats{ int32_t((key >> 20) & 0x3ff) - StatOffset, int32_t((key >> 10) & 0x3ff) - StatOffset, int32_t(key & 0x3ff) - StatOffset };
+}
+
+//stats after an effect (clamped, as PlayMode::draw does before they are next checked):
+static Stats apply(Stats s, Story::Node const &effect) {
+	s.academics = std::min(s.academics + effect.academics, int32_t(StoryRules::MaxStat));
+	s.social = std::min(s.social + effect.social, int32_t(StoryRules::MaxStat));
+	s.health = std::min(s.health + effect.health, int32_t(StoryRules::MaxStat));
+	return s;
+}
+
+//the ending (event index) that a state at 'event' leads to immediately, or -1U if the game continues:
+static uint32_t ending(uint32_t event, Stats const &s) {
+	if (event >= StoryRules::PassEvent) return event;
+	if (s.academics <= 0) return StoryRules::FailAcademicsEvent;
+	if (s.social <= 0) return StoryRules::FailSocialEvent;
+	if (s.health <= 0) return StoryRules::FailHealthEvent;
+	return -1U;
+}
+
+//the chance of the first effect of an option:
+static double first_effect_probability(Story::Option const &option) {
+	return std::max(0.0, std::min(1.0, double(option.prob)));
+}
+
+static char const *OutcomeNames[4] = { "PASS", "FAIL_ACADEMICS", "FAIL_SOCIAL", "FAIL_HEALTH" };
+
+struct Result {
+	std::array< double, 4 > outcomes{}; //probability of each ending
+	std::array< double, 3 > mean_stats{}; //expected final stats
+	size_t states = 0; //distinct (event, stats) states visited
+};
+
+//a policy gives the probability of picking the first option at a choice:
+using Policy = std::function< double(uint32_t event, uint32_t choice_index, Stats const &stats) >;
+
+//push probability mass forward through the story line:
+static Result propagate(Story const &story, Policy const &policy) {
+	Result result;
+
+	std::unordered_map< uint32_t, double > current, next;
+	current.emplace(pack(Stats{ StoryRules::StartStat, StoryRules::StartStat, StoryRules::StartStat }), 1.0);
+
+	uint32_t choice_index = 0;
+	for (uint32_t event = 0; !current.empty(); ++event) {
+		result.states += current.size();
+		next.clear();
+
+		Story::Node const &node = story.node(StoryRules::StoryLine[std::min(event, uint32_t(StoryRules::PassEvent))]);
+		bool is_choice = (event < StoryRules::PassEvent && node.type == Story::Node::Choice);
+
+		for (auto const &[key, mass] : current) {
+			Stats stats = unpack(key);
+			uint32_t end = ending(event, stats);
+			if (end != -1U) {
+				result.outcomes[end - StoryRules::PassEvent] += mass;
+				result.mean_stats[0] += mass * stats.academics;
+				result.mean_stats[1] += mass * stats.social;
+				result.mean_stats[2] += mass * stats.health;
+				continue;
+			}
+			if (!is_choice) {
+				//dialogue, effect, or missing node: continue to the next event
+				next[key] += mass;
+				continue;
+			}
+			double first = policy(event, choice_index, stats);
+			for (uint32_t o = 0; o < 2; ++o) {
+				double pick = (o == 0 ? first : 1.0 - first);
+				if (pick == 0.0) continue;
+				Story::Option const &option = node.options[o];
+				double p1 = first_effect_probability(option);
+				if (p1 > 0.0) next[pack(apply(stats, story.node(option.effect1_id)))] += mass * pick * p1;
+				if (p1 < 1.0) next[pack(apply(stats, story.node(option.effect2_id)))] += mass * pick * (1.0 - p1);
+			}
+		}
+		if (is_choice) choice_index += 1;
+		std::swap(current, next);
+	}
+
+	return result;
+}
+
+//best stat-aware policy, by memoized recursion over states:
+struct Optimizer {
+	Optimizer(Story const &story_) : story(story_), memo(StoryRules::Events) { }
+
+	Story const &story;
+
+	//probability of passing from each state, and (for choices) whether the first option is best:
+	struct Value {
+		double pass = 0.0;
+		bool pick_first = true;
+	};
+	std::vector< std::unordered_map< uint32_t, Value > > memo; //indexed by event
+
+	double pass(uint32_t event, Stats const &stats) {
+		uint32_t end = ending(event, stats);
+		if (end != -1U) return (end == StoryRules::PassEvent ? 1.0 : 0.0);
+
+		uint32_t key = pack(stats);
+		auto f = memo[event].find(key);
+		if (f != memo[event].end()) return f->second.pass;
+
+		Value value;
+		Story::Node const &node = story.node(StoryRules::StoryLine[event]);
+		if (node.type != Story::Node::Choice) {
+			value.pass = pass(event + 1, stats);
+		} else {
+			double best[2];
+			for (uint32_t o = 0; o < 2; ++o) {
+				Story::Option const &option = node.options[o];
+				double p1 = first_effect_probability(option);
+				best[o] = 0.0;
+				if (p1 > 0.0) best[o] += p1 * pass(event + 1, apply(stats, story.node(option.effect1_id)));
+				if (p1 < 1.0) best[o] += (1.0 - p1) * pass(event + 1, apply(stats, story.node(option.effect2_id)));
+			}
+			value.pick_first = (best[0] >= best[1]);
+			value.pass = std::max(best[0], best[1]);
+		}
+		memo[event].emplace(key, value);
+		return value.pass;
+	}
+
+	//the policy found by pass() (call pass() from the start state first):
+	Policy policy() {
+		return [this](uint32_t event, uint32_t, Stats const &stats) {
+			pass(event, stats); //(in case the state wasn't visited)
+			return memo[event].at(pack(stats)).pick_first ? 1.0 : 0.0;
+		};
+	}
+};
+
+static void report(Result const &result) {
+	for (uint32_t i = 0; i < 4; ++i) {
+		std::printf("  %-15s %8.4f%%\n", OutcomeNames[i], 100.0 * result.outcomes[i]);
+	}
+	std::printf("  expected final stats: academics %.2f, social %.2f, health %.2f\n", result.mean_stats[0], result.mean_stats[1], result.mean_stats[2]);
+	std::printf("  (%zu states)\n", result.states);
+}
+
+static Policy mask_policy(uint32_t mask) {
+	return [mask](uint32_t, uint32_t choice_index, Stats const &) {
+		return ((mask >> choice_index) & 1) ? 0.0 : 1.0;
+	};
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+	std::string policy_name = "optimal";
+	bool decisions = false;
+	std::string story_path = data_path("story.bin");
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--policy" && i + 1 < argc) {
+			policy_name = argv[++i];
+		} else if (arg == "--decisions") {
+			decisions = true;
+		} else if (arg.size() > 0 && arg[0] != '-') {
+			story_path = arg;
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--policy first|second|random|<mask>|optimal] [--decisions] [story.bin]" << std::endl;
+			return 1;
+		}
+	}
+
+	Story story(story_path);
+
+	auto before = std::chrono::high_resolution_clock::now();
+
+	if (policy_name == "optimal") {
+		Optimizer optimizer(story);
+		Stats start{ StoryRules::StartStat, StoryRules::StartStat, StoryRules::StartStat };
+		optimizer.pass(0, start);
+
+		std::printf("Best stat-aware policy:\n");
+		report(propagate(story, optimizer.policy()));
+
+		//best fixed sequence of options:
+		uint32_t choices = 0;
+		for (uint32_t id : StoryRules::StoryLine) {
+			if (story.node(id).type == Story::Node::Choice) choices += 1;
+		}
+		if (choices > 20) throw std::runtime_error("Too many choices (" + std::to_string(choices) + ") to try every mask.");
+		uint32_t best_mask = 0;
+		Result best;
+		for (uint32_t mask = 0; mask < (1U << choices); ++mask) {
+			Result result = propagate(story, mask_policy(mask));
+			if (mask == 0 || result.outcomes[0] > best.outcomes[0]) {
+				best = result;
+				best_mask = mask;
+			}
+		}
+		std::printf("Best fixed policy (mask 0x%04x; bit i set = second option at choice i):\n", best_mask);
+		report(best);
+
+		if (decisions) {
+			std::printf("Best stat-aware decisions (academics/social/health -> option, pass chance):\n");
+			for (uint32_t event = 0; event < StoryRules::PassEvent; ++event) {
+				Story::Node const &node = story.node(StoryRules::StoryLine[event]);
+				if (node.type != Story::Node::Choice) continue;
+				std::printf("  event %u (choice %u):\n", event, StoryRules::StoryLine[event]);
+				std::vector< std::pair< uint32_t, Optimizer::Value > > states(optimizer.memo[event].begin(), optimizer.memo[event].end());
+				std::sort(states.begin(), states.end(), [](auto const &a, auto const &b) { return a.first > b.first; });
+				for (auto const &[key, value] : states) {
+					Stats s = unpack(key);
+					std::printf("    %3d/%3d/%3d -> %s (%.2f%%)\n", s.academics, s.social, s.health, value.pick_first ? "first" : "second", 100.0 * value.pass);
+				}
+			}
+		}
+	} else {
+		Policy policy;
+		if (policy_name == "first") policy = mask_policy(0);
+		else if (policy_name == "second") policy = mask_policy(-1U);
+		else if (policy_name == "random") policy = [](uint32_t, uint32_t, Stats const &) { return 0.5; };
+		else policy = mask_policy(uint32_t(std::stoul(policy_name, nullptr, 0)));
+
+		std::printf("Policy '%s':\n", policy_name.c_str());
+		report(propagate(story, policy));
+	}
+
+	auto after = std::chrono::high_resolution_clock::now();
+	std::printf("Solved in %.3f seconds.\n", std::chrono::duration< double >(after - before).count());
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}